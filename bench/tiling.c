@@ -0,0 +1,114 @@
+// Exact repulsion with and without cache tiles. `./nob bench` builds this
+// twice, once with `GR_TILING`, and runs both. The perf counters show the
+// cache misses per pair interaction of the force phase; where they are not
+// permitted only the time per step is reported. By default the sources are
+// twice as large as the L2 cache, which is the case the tiles are for. The
+// dense adjacency matrix of such a graph may not fit into memory, pass a
+// smaller number of verticies then.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../gray.h"
+
+#ifdef GR_TILING
+#   define PATH "tiled"
+#else
+#   define PATH "untiled"
+#endif // GR_TILING
+
+#define STEPS 3
+// Bytes of a source of the repulsion: position, mass, degree and force
+#define SOURCE_SIZE 24
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Size of the L2 cache, from sysfs since containers often hide it from sysconf
+static size_t l2_size(void)
+{
+    for (int index = 0; ; index += 1) {
+        char path[64], level[8] = { 0 }, type[32] = { 0 }, size[16] = { 0 };
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/level", index);
+        FILE *file = fopen(path, "r");
+        if (file == NULL) {
+            return 1024 * 1024;
+        }
+        const bool read_level = fgets(level, sizeof(level), file) != NULL;
+        fclose(file);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/type", index);
+        file = fopen(path, "r");
+        const bool read_type = file != NULL && fgets(type, sizeof(type), file) != NULL;
+        if (file != NULL) { fclose(file); }
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", index);
+        file = fopen(path, "r");
+        const bool read_size = file != NULL && fgets(size, sizeof(size), file) != NULL;
+        if (file != NULL) { fclose(file); }
+        if (!read_level || !read_type || !read_size || atoi(level) != 2 ||
+            strncmp(type, "Instruction", 11) == 0) {
+            continue;
+        }
+        char *unit = NULL;
+        const size_t bytes = strtoul(size, &unit, 10);
+        return bytes * (*unit == 'K' ? 1024 : *unit == 'M' ? 1024 * 1024 : 1);
+    }
+}
+
+static void bench(const Graph *g, const enum gr_RenderMethodKind kind, const char *name)
+{
+    srand(1);
+    RenderContext ctx = render_ctx_create_ex(g, gr_method_create(kind), INIT_RANDOM);
+    // builds the render state, which is not measured
+    render_step(&ctx);
+
+    Perf perf = { 0 };
+    perf_init(&perf);
+    ctx.perf = &perf;
+    const double start = now();
+    render_step_for(&ctx, STEPS);
+    const double seconds = (now() - start) / STEPS;
+
+    const uint64_t pairs = perf.pairs[GR_PERF_FORCES];
+    printf("%-8s %-22s %8zu verticies %9.2f ms/step %7.3f ns/pair", PATH, name,
+           g->n_verticies, seconds * 1e3, seconds * 1e9 * STEPS / (double)pairs);
+    if (perf.fds[GR_PERF_CACHE_MISSES] >= 0) {
+        printf(" %8.5f cache-misses/pair",
+               (double)perf.values[GR_PERF_FORCES][GR_PERF_CACHE_MISSES] / (double)pairs);
+    } else {
+        printf(" cache-misses unavailable (%s)", strerror(perf.error));
+    }
+    printf("\n");
+
+    perf_destroy(&perf);
+    render_ctx_destroy(&ctx);
+}
+
+int main(int argc, char **argv)
+{
+    const size_t l2 = l2_size();
+    const size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 2 * l2 / SOURCE_SIZE;
+    Graph g = { 0 };
+    if (!graph_init(&g, n)) {
+        fprintf(stderr, "Could not create a graph of %zu verticies, its adjacency matrix "
+                "needs %.1f GiB\n", n, (double)n * (double)n / (1 << 30));
+        return EXIT_FAILURE;
+    }
+    printf("%-8s %zu KiB of sources, %zu KiB of L2 cache\n", PATH, n * SOURCE_SIZE / 1024,
+           l2 / 1024);
+    srand(2);
+    for (size_t i = 1; i < n; i += 1) {
+        graph_add_edge(&g, edge_u(rand() % i, i));
+    }
+
+    bench(&g, GR_RM_Eades, "Eades");
+    bench(&g, GR_RM_Fruchterman_and_Reingold, "Fruchterman-Reingold");
+    bench(&g, GR_RM_ForceAtlas2, "ForceAtlas2");
+
+    graph_destroy(&g);
+    return EXIT_SUCCESS;
+}
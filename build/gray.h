@@ -0,0 +1,5899 @@
+#ifdef GRAY_IMPLEMENTATION
+// `syscall` (and the POSIX parts of the system headers) are hidden in strict
+// ISO C modes like `-std=c11` otherwise
+#ifndef _DEFAULT_SOURCE
+#   define _DEFAULT_SOURCE
+#endif // _DEFAULT_SOURCE
+
+#endif // GRAY_IMPLEMENTATION
+
+#ifndef _GRAY_H_
+#define _GRAY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#ifndef GR_REQUIRE_PREFIX
+#   define Index gr_Index
+#   define Vec2 gr_Vec2
+#       define vec2 gr_vec2
+#       define vec2zero gr_vec2zero
+#       define vec2one gr_vec2one
+#   define Allocator gr_Allocator
+#       define allocator_default gr_allocator_default
+#   define Arena gr_Arena
+#   define bitmap_words gr_bitmap_words
+#   define bitmap_get gr_bitmap_get
+#   define bitmap_set gr_bitmap_set
+#   define bitmap_clear gr_bitmap_clear
+#   define Graph gr_Graph
+#       define Edge gr_Edge
+#       define edge_u gr_edge_u
+#       define edge_d gr_edge_d
+#       define EdgeLength gr_EdgeLength
+#   define RenderMethodKind gr_RenderMethodKind
+#   define RenderMethod gr_RenderMethod
+#       define RM_Eades GR_RM_Eades
+#       define RM_Fruchterman_and_Reingold GR_RM_Fruchterman_and_Reingold
+#       define RM_SPRING_1 GR_RM_SPRING_1
+#       define RM_SPRING_2 GR_RM_SPRING_2
+#   define RenderContext gr_RenderContext
+#   define Binding gr_Binding
+#       define binding gr_binding
+#   define BindType gr_BindType
+#       define BIND_FLOAT GR_BIND_FLOAT
+#       define BIND_DOUBLE GR_BIND_DOUBLE
+#   define InitPositions gr_InitPositions
+#       define INIT_NONE GR_INIT_NONE
+#       define INIT_RANDOM GR_INIT_RANDOM
+#       define INIT_SPECTRAL GR_INIT_SPECTRAL
+#   define VertexOrder gr_VertexOrder
+#       define ORDER_NONE GR_ORDER_NONE
+#       define ORDER_RCM GR_ORDER_RCM
+#       define ORDER_HILBERT GR_ORDER_HILBERT
+#   define graph_init_ex gr_graph_init_ex
+#   define graph_init gr_graph_init
+#   define graph_destroy gr_graph_destroy
+#   define graph_add_edge_ex gr_graph_add_edge_ex
+#   define graph_add_edge gr_graph_add_edge
+#   define graph_add_edges gr_graph_add_edges
+
+#   define render_ctx_create_alloc gr_render_ctx_create_alloc
+#   define render_ctx_create_ex gr_render_ctx_create_ex
+#   define render_ctx_create gr_render_ctx_create
+#   define render_ctx_destroy gr_render_ctx_destroy
+#   define render_ctx_spectral gr_render_ctx_spectral
+#   define render_ctx_normalize_ex gr_render_ctx_normalize_ex
+#   define render_ctx_normalize gr_render_ctx_normalize
+#   define render_ctx_normalize_into_ex gr_render_ctx_normalize_into_ex
+#   define render_ctx_normalize_into gr_render_ctx_normalize_into
+#   define render_ctx_normalize_bound_ex gr_render_ctx_normalize_bound_ex
+#   define render_ctx_normalize_bound gr_render_ctx_normalize_bound
+#   define render_ctx_update_bbox gr_render_ctx_update_bbox
+#   define render_step gr_render_step
+#   define render_step_for gr_render_step_for
+#   define render_step_until gr_render_step_until
+#   define render_run gr_render_run
+
+#   define SmallContext gr_SmallContext
+#   define small_ctx_create_ex gr_small_ctx_create_ex
+#   define small_ctx_create gr_small_ctx_create
+#   define small_add_edge gr_small_add_edge
+#   define small_normalize_into_ex gr_small_normalize_into_ex
+#   define small_normalize_into gr_small_normalize_into
+#   define small_step gr_small_step
+#   define small_step_for gr_small_step_for
+#   define small_step_until gr_small_step_until
+#   define small_run gr_small_run
+
+#   define Snapshot gr_Snapshot
+#   define AsyncLayout gr_AsyncLayout
+#   define async_start_ex gr_async_start_ex
+#   define async_start gr_async_start
+#   define async_acquire gr_async_acquire
+#   define async_pause gr_async_pause
+#   define async_resume gr_async_resume
+#   define async_step gr_async_step
+#   define async_cancel gr_async_cancel
+#   define async_done gr_async_done
+#   define async_destroy gr_async_destroy
+#   define snapshot_normalize_bound_ex gr_snapshot_normalize_bound_ex
+#   define snapshot_normalize_bound gr_snapshot_normalize_bound
+
+#   define Perf gr_Perf
+#   define PerfPhase gr_PerfPhase
+#   define PerfCounter gr_PerfCounter
+#   define perf_init gr_perf_init
+#   define perf_destroy gr_perf_destroy
+#   define perf_reset gr_perf_reset
+#   define perf_report gr_perf_report
+#endif // GR_REQUIRE_PREFIX
+
+#ifndef GR_DEFAULT_METHOD
+#   define GR_DEFAULT_METHOD GR_RM_SPRING_1
+#endif // GR_DEFAULT_METHOD
+
+#ifndef GR_DEFAULT_ITERATIONS
+#   define GR_DEFAULT_ITERATIONS 100
+#endif // GR_DEFAULT_ITERATIONS
+
+// Number of consecutive steps a vertex has to stay below
+// `gr_RenderContext.freeze_threshold` before it is frozen
+#ifndef GR_FREEZE_STEPS
+#   define GR_FREEZE_STEPS 5
+#endif // GR_FREEZE_STEPS
+
+// Components of up to this many verticies use all pairs in `GR_RM_SGD`,
+// larger ones the sparse approximation with `GR_SGD_PIVOTS` pivots
+#ifndef GR_SGD_EXACT_LIMIT
+#   define GR_SGD_EXACT_LIMIT 1024
+#endif // GR_SGD_EXACT_LIMIT
+#ifndef GR_SGD_PIVOTS
+#   define GR_SGD_PIVOTS 64
+#endif // GR_SGD_PIVOTS
+
+// Capacity of the neighbor list of every vertex with `verlet_cutoff`, the
+// closest ones are kept
+#ifndef GR_VERLET_NEIGHBORS
+#   define GR_VERLET_NEIGHBORS 32
+#endif // GR_VERLET_NEIGHBORS
+
+// Defining `GR_TILING` for the implementation calculates the exact repulsion
+// of blocks too large for the L1 cache in cache sized tiles. Eades and
+// Fruchterman-Reingold then push each tile of verticies from the positions
+// at the start of the tile instead of the moved ones, which changes the
+// layout. It is off until it measurably pays off, compare both with
+// `./nob bench`.
+
+// Number of steps after which `GR_ORDER_HILBERT` sorts the verticies again
+#ifndef GR_REORDER_STEPS
+#   define GR_REORDER_STEPS 25
+#endif // GR_REORDER_STEPS
+
+// Vertex index stored in graphs and render states. Defining `GR_INDEX32`
+// (for the implementation and every user alike) halves the memory of the
+// adjacency lists, neighbor lists and stress terms, but limits graphs to
+// `UINT32_MAX` verticies. The API still takes `size_t`.
+#ifdef GR_INDEX32
+typedef uint32_t gr_Index;
+#   define GR_INDEX_MAX UINT32_MAX
+#else
+typedef size_t gr_Index;
+#   define GR_INDEX_MAX SIZE_MAX
+#endif // GR_INDEX32
+
+typedef struct {
+    float x;
+    float y;
+} gr_Vec2;
+
+#define gr_vec2(x_, y_) ((gr_Vec2) { .x = (x_), .y = (y_) })
+#define gr_vec2zero()   gr_vec2(0, 0)
+#define gr_vec2one()    gr_vec2(1, 1)
+
+// Bitmaps with one bit per vertex, stored in 64 bit words
+#define gr_bitmap_words(n)          (((n) + 63) / 64)
+#define gr_bitmap_get(bits, i)      (((bits)[(i) / 64] >> ((i) % 64)) & 1)
+#define gr_bitmap_set(bits, i)      ((bits)[(i) / 64] |= (uint64_t)1 << ((i) % 64))
+#define gr_bitmap_clear(bits, i)    ((bits)[(i) / 64] &= ~((uint64_t)1 << ((i) % 64)))
+
+#define gr_randf(min, max)\
+    ((min) + (float)rand() / (float)(RAND_MAX) * ((max) - (min)))
+#define gr_lerpf(v, min1, max1, min2, max2)\
+    (min2 + ((v - min1) / (max1 - min1)) * (max2 - min2))
+
+// Allocation hooks, every function gets `user` passed as first argument.
+// All heap memory of graphs and render contexts goes through these.
+typedef struct {
+    void *(*malloc_fn)(void *user, size_t size);
+    void *(*calloc_fn)(void *user, size_t count, size_t size);
+    void (*free_fn)(void *user, void *ptr);
+    void *user;
+} gr_Allocator;
+
+// Allocator using `malloc`, `calloc` and `free` of the C standard library
+gr_Allocator gr_allocator_default(void);
+
+// Bump allocator for scratch memory of a single render step. It is reset at
+// the end of every step and consolidated into one block large enough for the
+// whole step, so after the first step no more heap allocations are necessary.
+typedef struct {
+    struct gr_ArenaBlock *blocks;
+} gr_Arena;
+
+// Ideal length of the edge from `start` to `end` relative to the other edges
+typedef struct {
+    gr_Index start;
+    gr_Index end;
+    float length;
+} gr_EdgeLength;
+
+typedef struct {
+    size_t n_verticies;
+    bool **edges;
+    // Number of `true` entries in `edges`
+    size_t n_edges;
+    // Lengths of the edges which were given one other than 1, at most one
+    // entry per direction of an edge. All other edges have length 1.
+    gr_EdgeLength *lengths;
+    size_t n_lengths;
+    size_t lengths_capacity;
+    // Incremented whenever a length changes
+    size_t lengths_version;
+    // Union-find forest over the verticies, updated while adding edges. Roots
+    // identify the (weakly) connected components.
+    gr_Index *component_parent;
+    gr_Allocator allocator;
+} gr_Graph;
+
+// Only used in the API for adding edges.
+typedef struct {
+    size_t start;
+    size_t end;
+    bool directed;
+} gr_Edge;
+
+#define gr_edge_u(a, b) ((gr_Edge) { .start = (a), .end = (b), .directed = false })
+#define gr_edge_d(a, b) ((gr_Edge) { .start = (a), .end = (b), .directed = true })
+
+enum gr_RenderMethodKind {
+    GR_RM_Eades,
+    GR_RM_Fruchterman_and_Reingold,
+    GR_RM_SGD,
+    GR_RM_ForceAtlas2,
+};
+
+#define GR_RM_SPRING_1 GR_RM_Eades
+#define GR_RM_SPRING_2 GR_RM_Fruchterman_and_Reingold
+#define GR_RM_STRESS GR_RM_SGD
+#define GR_RM_FORCE_ATLAS GR_RM_ForceAtlas2
+
+#define GR_DEFAULT_GRAV_CEN gr_vec2zero()
+
+#define GR_DEFAULT_EADES_C1       2
+#define GR_DEFAULT_EADES_C2       1
+#define GR_DEFAULT_EADES_C3       1
+#define GR_DEFAULT_EADES_C4       0.1
+
+struct gr_RenderMethodEades {
+    const enum gr_RenderMethodKind kind;
+    // c1 and c2 are used to calculate the force of a spring
+    float c1;
+    float c2;
+    // used to calculate the repellent force between unconnected verticies
+    float c3;
+    // multiplied with the force to move the vertex
+    float c4;
+    // Center of gravity
+    gr_Vec2 grav_cen;
+};
+
+#define GR_DEFAULT_FRUCHTGOLD_C                     0.1f
+#define GR_DEFAULT_FRUCHTGOLD_AREA                  100
+#define GR_DEFAULT_FRUCHTGOLD_TEMP                  0.1f
+#define GR_DEFAULT_FRUCHTGOLD_DECAY(temp, iters)    ((temp) / (iters))
+
+// Fruchterman and Reingold implementation.
+// To disable temperature set `cur_temp = 1` and `decay = 0`
+struct gr_RenderMethodFruchtgold {
+    const enum gr_RenderMethodKind kind;
+    float c;
+    float area;
+    float cur_temp;
+    float decay;
+    // Center of gravity
+    gr_Vec2 grav_cen;
+};
+
+#define GR_DEFAULT_SGD_LENGTH       1
+#define GR_DEFAULT_SGD_EPSILON      0.1f
+#define GR_DEFAULT_SGD_ITERATIONS   15
+#define GR_DEFAULT_SGD_PIVOTS       0
+
+// Stress layout by stochastic gradient descent (Zheng, Pawar and Goodman).
+// Every step moves the verticies of all pairs, in random order, towards their
+// distance in the graph. The step size is annealed from `1 / w_min` down to
+// `epsilon / w_max` within `iterations` steps and stays there afterwards.
+struct gr_RenderMethodSGD {
+    const enum gr_RenderMethodKind kind;
+    // Distance of verticies connected by an edge
+    float length;
+    float epsilon;
+    size_t iterations;
+    // Number of pivots of the sparse approximation, which only keeps the
+    // distances along edges and to the pivots. `0` uses all pairs up to
+    // `GR_SGD_EXACT_LIMIT` verticies per component and `GR_SGD_PIVOTS` pivots
+    // for larger ones.
+    size_t pivots;
+    // Center of gravity, only used to place components
+    gr_Vec2 grav_cen;
+};
+
+#define GR_DEFAULT_FORCEATLAS2_SCALING      2
+#define GR_DEFAULT_FORCEATLAS2_GRAVITY      1
+#define GR_DEFAULT_FORCEATLAS2_TOLERANCE    1
+
+// ForceAtlas2 (Jacomy, Venturini, Heymann and Bastian). Verticies repel each
+// other proportional to their degrees, so hubs push their surroundings away,
+// and every vertex moves with its own speed depending on how much it swings.
+struct gr_RenderMethodForceAtlas2 {
+    const enum gr_RenderMethodKind kind;
+    // Strength of the repulsion, the layout gets larger with it
+    float scaling;
+    float gravity;
+    // Gravity growing with the distance to the center instead of a constant
+    // pull, keeps everything compact
+    bool strong_gravity;
+    // Logarithmic attraction, which makes clusters much tighter
+    bool lin_log;
+    // Divide the attraction of a vertex by its degree, hubs end up at the
+    // border of their clusters and authorities in the middle
+    bool dissuade_hubs;
+    // How much swinging is accepted to speed up, lower is more precise
+    float tolerance;
+    // Center of gravity
+    gr_Vec2 grav_cen;
+};
+
+typedef union {
+    enum gr_RenderMethodKind kind;
+    struct gr_RenderMethodEades eades;
+    struct gr_RenderMethodFruchtgold fruchtgold;
+    struct gr_RenderMethodSGD sgd;
+    struct gr_RenderMethodForceAtlas2 force_atlas;
+} gr_RenderMethod;
+
+// Phases of `gr_render_step` which are measured by the perf counters
+enum gr_PerfPhase {
+    // The whole step
+    GR_PERF_STEP,
+    // Force calculation and integration of the render method
+    GR_PERF_FORCES,
+    // Placing the verticies which were removed from the layout
+    GR_PERF_EXPAND,
+    // Packing of the connected components and writing back the positions
+    GR_PERF_PACK,
+    GR_PERF_PHASE_COUNT,
+};
+
+enum gr_PerfCounter {
+    GR_PERF_CYCLES,
+    GR_PERF_INSTRUCTIONS,
+    GR_PERF_CACHE_MISSES,
+    GR_PERF_BRANCH_MISSES,
+    GR_PERF_COUNTER_COUNT,
+};
+
+// Optional hardware performance counters (Linux `perf_event_open`) sampled
+// around the phases of every `gr_render_step`, read together as one group.
+// Only the thread calling `gr_render_step` is measured, so the values per pair
+// interaction are only meaningful with `n_threads == 1`.
+// If the kernel does not permit perf events (or on other platforms) the
+// counters are reported as unavailable and the stepping is not affected.
+typedef struct {
+    // `-1` for every counter that could not be opened
+    int fds[GR_PERF_COUNTER_COUNT];
+    // `errno` of the first failed `perf_event_open`, `0` if all were opened
+    int error;
+    uint64_t steps;
+    // Most threads any of the measured steps ran on
+    size_t max_threads;
+    uint64_t values[GR_PERF_PHASE_COUNT][GR_PERF_COUNTER_COUNT];
+    // Number of evaluated vertex pair interactions
+    uint64_t pairs[GR_PERF_PHASE_COUNT];
+    // Counter readings at the start of the currently running phases
+    uint64_t begin[GR_PERF_PHASE_COUNT][GR_PERF_COUNTER_COUNT];
+} gr_Perf;
+
+// How `gr_render_ctx_create_ex` initializes the positions. `false` and `true`
+// can still be passed for `GR_INIT_NONE` and `GR_INIT_RANDOM`.
+enum gr_InitPositions {
+    // Not even allocated, you have to set `vertex_pos` yourself
+    GR_INIT_NONE,
+    // Uniformly distributed in `[0, 1]` using `rand`
+    GR_INIT_RANDOM,
+    // Layout of `gr_render_ctx_spectral`
+    GR_INIT_SPECTRAL,
+};
+
+// Component type of a `gr_Binding`
+enum gr_BindType {
+    GR_BIND_FLOAT,
+    GR_BIND_DOUBLE,
+};
+
+// Positions inside a buffer of the caller, for example the position members
+// of an array of vertex structs: the x coordinate of vertex `i` is at
+// `base + i * stride` bytes, directly followed by its y coordinate.
+typedef struct {
+    void *base;
+    size_t stride;
+    enum gr_BindType type;
+} gr_Binding;
+
+#define gr_binding(base_, stride_, type_) \
+    ((gr_Binding) { .base = (base_), .stride = (stride_), .type = (type_) })
+
+// Internal order of the laid out verticies, see `gr_RenderContext.vertex_order`
+enum gr_VertexOrder {
+    // Order of the graph (within every component)
+    GR_ORDER_NONE,
+    // Reverse Cuthill-McKee: neighbors get close numbers, computed once
+    GR_ORDER_RCM,
+    // Along a Hilbert curve over the current positions: verticies close to
+    // each other get close numbers, recomputed every `GR_REORDER_STEPS` steps
+    GR_ORDER_HILBERT,
+};
+
+typedef struct {
+    const gr_Graph *graph;
+    gr_RenderMethod method;
+    // Just stored weather the positions were allocated by `gr_render_ctx_create_ex`.
+    // Only used in `gr_render_ctx_destroy`
+    bool positions_initialized;
+
+    gr_Vec2 *vertex_pos;
+    // Buffer of the caller every step writes the positions to as well, in
+    // the same pass that moves them out of the internal layout. Not used if
+    // `output.base` is `NULL` (the default).
+    gr_Binding output;
+    size_t cur_iteration;
+    // Bounding box of `vertex_pos`, kept up to date by the functions of the
+    // context as a by-product of moving the verticies. Call
+    // `gr_render_ctx_update_bbox` after changing `vertex_pos` yourself.
+    gr_Vec2 bbox_min;
+    gr_Vec2 bbox_max;
+
+    // Set to sample hardware performance counters, `NULL` by default
+    gr_Perf *perf;
+
+    // Lay out every connected component on its own and pack the components
+    // into a compact rectangle afterwards. Components are distributed over
+    // the threads.
+    bool split_components;
+    // Recursively strip all verticies of degree one (trees hanging off the
+    // 2-core) before laying out and reinsert them around their anchors after
+    // every step
+    bool prune_leaves;
+    // Contract maximal paths of degree two verticies into single edges whose
+    // ideal length is scaled by the length of the path. The inner verticies
+    // are placed along the contracted edge after every step.
+    bool compress_chains;
+    // Lay out only one representative of every class of verticies with the
+    // same neighbors, weighted by the size of the class. The others are
+    // fanned out around it after every step.
+    bool collapse_twins;
+    // Verticies which moved less than this fraction of the ideal edge length
+    // for `GR_FREEZE_STEPS` steps are frozen: their forces are not calculated
+    // anymore, but they still act on the others. A neighbor moving more than
+    // a few times as far wakes them up again. `0` disables freezing, which
+    // `GR_RM_SGD` ignores.
+    float freeze_threshold;
+    // Bitmap of verticies which are never moved (see `gr_bitmap_words`),
+    // `NULL` if all verticies are movable. Their forces are not calculated at
+    // all, the others are still laid out around them. Pinned verticies are
+    // never removed by `prune_leaves`, `compress_chains` or `collapse_twins`.
+    // The bitmap can be changed between steps, pointing to another one starts
+    // over.
+    const uint64_t *pinned;
+    // Number of random verticies every vertex is repelled by in a step instead
+    // of all others, scaled up to stand for all of them. Attraction then only
+    // follows the edges. `0` calculates the exact repulsion, `GR_RM_SGD`
+    // ignores it.
+    size_t repulsion_samples;
+    // Only verticies closer than this multiple of the ideal edge length repel
+    // each other. They are remembered in neighbor lists, which are rebuilt
+    // once a vertex moved far enough to possibly have new neighbors. Takes
+    // precedence over `repulsion_samples`, `0` disables it.
+    float verlet_cutoff;
+    // Approximates square roots, logarithms and divisions in the loops over
+    // pairs and edges, so the compiler can vectorize them. Single forces are
+    // off by less than 0.6% (ForceAtlas2 repulsion 0.001%), which does not
+    // make the layouts worse.
+    bool fast_math;
+    // Renumbers the verticies internally, so the passes over edges and
+    // nearby verticies touch memory close together. `vertex_pos`, `pinned`
+    // and everything else still use the ids of the graph.
+    enum gr_VertexOrder vertex_order;
+    // Number of threads used by `gr_render_step`, `1` runs everything on the
+    // calling thread
+    size_t n_threads;
+
+    gr_Allocator allocator;
+    // Scratch memory of the current step
+    gr_Arena scratch;
+    // Number of allocations done through `allocator`. Stays constant for
+    // every `gr_render_step` after the first one (checked by an assertion).
+    // Changing the graph or the options of the context starts over.
+    size_t heap_allocs;
+
+    // Internal data derived from the graph and the options, created by the
+    // first step.
+    struct gr_RenderState *state;
+} gr_RenderContext;
+
+// Most verticies of a `gr_SmallContext`
+#define GR_SMALL_MAX 64
+
+// Graph and layout of up to `GR_SMALL_MAX` verticies in one struct without
+// any heap memory: the edges of every vertex are a bitmask and the positions
+// are stored inline. Supports the spring methods (`GR_RM_Eades` and
+// `GR_RM_Fruchterman_and_Reingold`) with edges of length 1 and none of the
+// options of `gr_RenderContext`.
+typedef struct {
+    gr_RenderMethod method;
+    size_t n_verticies;
+    // Bit `u` of `edges[v]` is set if there is an edge from `v` to `u`
+    uint64_t edges[GR_SMALL_MAX];
+    gr_Vec2 vertex_pos[GR_SMALL_MAX];
+    size_t cur_iteration;
+    // Bounding box of `vertex_pos`, like in `gr_RenderContext`
+    gr_Vec2 bbox_min;
+    gr_Vec2 bbox_max;
+    // See `gr_RenderContext.fast_math`
+    bool fast_math;
+} gr_SmallContext;
+
+// Positions of a completed step, published by a layout thread
+typedef struct {
+    const gr_Vec2 *vertex_pos;
+    size_t n_verticies;
+    size_t iteration;
+    gr_Vec2 bbox_min;
+    gr_Vec2 bbox_max;
+} gr_Snapshot;
+
+// Steps a render context on a thread of its own, see `gr_async_start_ex`
+typedef struct gr_AsyncLayout gr_AsyncLayout;
+
+// Returns only false if the internal structures could not be allocated or
+// `n_verticies` does not fit into `gr_Index`.
+// If `allocator` is `NULL` the default allocator is used.
+bool gr_graph_init_ex(gr_Graph *graph, const size_t n_verticies,
+                      const gr_Allocator *allocator);
+bool gr_graph_init(gr_Graph *graph, const size_t n_verticies);
+void gr_graph_destroy(gr_Graph *graph);
+// `length` is the ideal length of the edge relative to the others and
+// replaces the one it had. `0` keeps the length of an existing edge (`1` for
+// new ones), `1` resets it to the default.
+bool gr_graph_add_edge_ex(gr_Graph *graph, const gr_Edge edge, const float length);
+bool gr_graph_add_edge(gr_Graph *graph, const gr_Edge edge);
+// Returns: `0` on success (already existing edges are ignored and won't lead to failure)
+// and `n` when the n-th edge could not be added, following edges are also not added yet.
+size_t gr_graph_add_edges(gr_Graph *graph, const size_t n_edges, const gr_Edge *edges);
+
+// Creates the default render method for the passed kind. Values in this method
+// can be tweaked.
+gr_RenderMethod gr_method_create(const enum gr_RenderMethodKind kind);
+#define gr_method_default() (gr_method_create(GR_DEFAULT_METHOD))
+
+// `init_positions` is one of `gr_InitPositions`, with `GR_INIT_NONE` (`false`)
+// you have to initialize `vertex_pos` yourself, it won't even be allocated.
+// All memory of the context is allocated through `allocator`, if it is `NULL`
+// the allocator of the graph is used.
+gr_RenderContext gr_render_ctx_create_alloc(const gr_Graph *graph,
+                                            const gr_RenderMethod method,
+                                            const int init_positions,
+                                            const gr_Allocator *allocator);
+gr_RenderContext gr_render_ctx_create_ex(const gr_Graph *graph,
+                                         const gr_RenderMethod method,
+                                         const int init_positions);
+#define gr_render_ctx_create(graph) \
+    (gr_render_ctx_create_ex((graph), gr_method_default(), true))
+void gr_render_ctx_destroy(gr_RenderContext *ctx);
+// Spectral layout (Hall): places the verticies at the eigenvectors of the two
+// smallest non-trivial eigenvalues of the graph Laplacian, found with the
+// Lanczos method. Much cheaper than stepping, use it as the final layout of
+// huge graphs or as a starting point for the render method. Edge lengths are
+// honored as inverse weights, components are centered on top of each other.
+void gr_render_ctx_spectral(gr_RenderContext *ctx);
+// Recomputes `bbox_min` and `bbox_max` from `vertex_pos`
+void gr_render_ctx_update_bbox(gr_RenderContext *ctx);
+// Lerps all positions into the rectangle described by `mins` and `maxs`
+void gr_render_ctx_normalize_ex(gr_RenderContext *ctx, const gr_Vec2 mins,
+                                const gr_Vec2 maxs);
+#define gr_render_ctx_normalize(ctx) \
+    (gr_render_ctx_normalize_ex((ctx), gr_vec2(0.05, 0.05), gr_vec2(0.95, 0.95)))
+// Like `gr_render_ctx_normalize_ex` but writes the positions to `out` (one per
+// vertex) and leaves `vertex_pos` untouched, so stepping can go on from there.
+// `out` can directly be a render buffer of the caller.
+void gr_render_ctx_normalize_into_ex(const gr_RenderContext *ctx, const gr_Vec2 mins,
+                                     const gr_Vec2 maxs, gr_Vec2 *out);
+#define gr_render_ctx_normalize_into(ctx, out) \
+    (gr_render_ctx_normalize_into_ex((ctx), gr_vec2(0.05, 0.05), \
+                                     gr_vec2(0.95, 0.95), (out)))
+// Like `gr_render_ctx_normalize_into_ex` but writes into a strided buffer,
+// for example straight into the vertex structs of a renderer
+void gr_render_ctx_normalize_bound_ex(const gr_RenderContext *ctx, const gr_Vec2 mins,
+                                      const gr_Vec2 maxs, const gr_Binding out);
+#define gr_render_ctx_normalize_bound(ctx, out) \
+    (gr_render_ctx_normalize_bound_ex((ctx), gr_vec2(0.05, 0.05), \
+                                      gr_vec2(0.95, 0.95), (out)))
+void gr_render_step(gr_RenderContext *ctx);
+void gr_render_step_for(gr_RenderContext *ctx, const size_t iterations);
+void gr_render_step_until(gr_RenderContext *ctx, const size_t target_iterations);
+#define gr_render_run(ctx) gr_render_step_until((ctx), GR_DEFAULT_ITERATIONS)
+
+// With `init_positions` the positions are uniformly distributed in `[0, 1]`
+// using `rand`, otherwise they are all zero.
+gr_SmallContext gr_small_ctx_create_ex(const size_t n_verticies,
+                                       const gr_RenderMethod method,
+                                       const bool init_positions);
+#define gr_small_ctx_create(n_verticies) \
+    (gr_small_ctx_create_ex((n_verticies), gr_method_default(), true))
+// Returns `false` if one of the verticies does not exist
+bool gr_small_add_edge(gr_SmallContext *ctx, const gr_Edge edge);
+void gr_small_normalize_into_ex(const gr_SmallContext *ctx, const gr_Vec2 mins,
+                                const gr_Vec2 maxs, gr_Vec2 *out);
+#define gr_small_normalize_into(ctx, out) \
+    (gr_small_normalize_into_ex((ctx), gr_vec2(0.05, 0.05), \
+                                gr_vec2(0.95, 0.95), (out)))
+void gr_small_step(gr_SmallContext *ctx);
+void gr_small_step_for(gr_SmallContext *ctx, const size_t iterations);
+void gr_small_step_until(gr_SmallContext *ctx, const size_t target_iterations);
+#define gr_small_run(ctx) gr_small_step_until((ctx), GR_DEFAULT_ITERATIONS)
+
+// Steps `ctx` on a thread of its own until it reaches `target_iterations`,
+// at most once every `interval` seconds (`0` as fast as possible), optionally
+// starting `paused`. `ctx` (its `output` is used for the snapshots) must not
+// be touched until `gr_async_destroy`, reading its graph is fine. Returns
+// `NULL` if the thread could not be started. With `GR_NO_THREADS` the steps
+// are done by `gr_async_acquire` instead.
+gr_AsyncLayout *gr_async_start_ex(gr_RenderContext *ctx, const size_t target_iterations,
+                                  const double interval, const bool paused);
+#define gr_async_start(ctx) \
+    (gr_async_start_ex((ctx), GR_DEFAULT_ITERATIONS, 0, false))
+// Latest published step, never waits for the layout thread. The snapshot
+// stays valid until the next call.
+const gr_Snapshot *gr_async_acquire(gr_AsyncLayout *async);
+void gr_async_pause(gr_AsyncLayout *async);
+void gr_async_resume(gr_AsyncLayout *async);
+// Lets a paused layout do one more step
+void gr_async_step(gr_AsyncLayout *async);
+// Stops after the current step, the layout cannot be resumed afterwards
+void gr_async_cancel(gr_AsyncLayout *async);
+// `true` once the target iteration is reached or the layout was cancelled
+bool gr_async_done(gr_AsyncLayout *async);
+// Resumes the layout and waits until it reached its target (cancel it first
+// to stop after the current step), then hands the context back
+void gr_async_destroy(gr_AsyncLayout *async);
+void gr_snapshot_normalize_bound_ex(const gr_Snapshot *snapshot, const gr_Vec2 mins,
+                                    const gr_Vec2 maxs, const gr_Binding out);
+#define gr_snapshot_normalize_bound(snapshot, out) \
+    (gr_snapshot_normalize_bound_ex((snapshot), gr_vec2(0.05, 0.05), \
+                                    gr_vec2(0.95, 0.95), (out)))
+
+// Returns `true` if at least one counter could be opened. Even on `false` the
+// perf struct can be attached to a render context and reported.
+bool gr_perf_init(gr_Perf *perf);
+void gr_perf_destroy(gr_Perf *perf);
+// Clears all accumulated values, the counters stay open
+void gr_perf_reset(gr_Perf *perf);
+// Prints cycles, instructions, IPC and misses per pair interaction of every
+// phase. The misses per pair are left out if steps ran on several threads.
+void gr_perf_report(const gr_Perf *perf, FILE *stream);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _GRAY_H_
+
+#ifndef _GRAY_ALREADY_IMPLEMENTED_
+#    ifdef GRAY_IMPLEMENTATION
+#        define _GRAY_ALREADY_IMPLEMENTED_
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#if defined(_WIN32) && !defined(GR_NO_THREADS)
+#   define GR_NO_THREADS
+#endif // _WIN32
+
+#ifndef GR_NO_THREADS
+#   include <pthread.h>
+#   include <stdatomic.h>
+#endif // GR_NO_THREADS
+
+#ifdef __linux__
+#   include <linux/perf_event.h>
+#   include <sys/ioctl.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#endif // __linux__
+
+#ifdef __cplusplus
+extern "C" {            // only here so it is also used in the created single header file
+#endif // __cplusplus
+
+#define gr_sq(n)   ((n) * (n))
+#define gr_not0f(n) ((n) == 0 ? 0.000000000001 : (n))
+
+#define GR_ARENA_ALIGN          16
+#define GR_ARENA_MIN_BLOCK      4096
+#define gr_align_up(n, a)       (((n) + (a) - 1) / (a) * (a))
+
+#define GR_PI                   3.14159265358979323846f
+// Maximal number of laid out neighbors pruned leaves are pushed away from
+#define GR_LEAF_REFS            8
+#define GR_LEAF_REFINE_ITERS    2
+// A vertex moving this many times the freeze threshold wakes up its neighbors
+#define GR_FREEZE_WAKE          4
+// Dimension of the Krylov space of the spectral layout
+#define GR_SPECTRAL_STEPS       64
+// Maximal number of times the Lanczos method is restarted from its best guess
+#define GR_SPECTRAL_RESTARTS    16
+// Residual (relative to the spectral bound) at which eigenvectors are accepted
+#define GR_SPECTRAL_TOLERANCE   1e-6
+// Jitter of the spectral layout relative to the ideal edge length, so
+// verticies ending up on the same spot can still be pushed apart
+#define GR_SPECTRAL_JITTER      0.05
+
+static void *gr_std_malloc(void *user, size_t size)
+{
+    (void)user;
+    return malloc(size);
+}
+
+static void *gr_std_calloc(void *user, size_t count, size_t size)
+{
+    (void)user;
+    return calloc(count, size);
+}
+
+static void gr_std_free(void *user, void *ptr)
+{
+    (void)user;
+    free(ptr);
+}
+
+gr_Allocator gr_allocator_default(void)
+{
+    return (gr_Allocator) {
+        .malloc_fn = gr_std_malloc,
+        .calloc_fn = gr_std_calloc,
+        .free_fn = gr_std_free,
+        .user = NULL,
+    };
+}
+
+static void *gr_ctx_malloc(gr_RenderContext *ctx, const size_t size)
+{
+    ctx->heap_allocs += 1;
+    return ctx->allocator.malloc_fn(ctx->allocator.user, size);
+}
+
+static void *gr_ctx_calloc(gr_RenderContext *ctx, const size_t count, const size_t size)
+{
+    ctx->heap_allocs += 1;
+    return ctx->allocator.calloc_fn(ctx->allocator.user, count, size);
+}
+
+static void gr_ctx_free(gr_RenderContext *ctx, void *ptr)
+{
+    ctx->allocator.free_fn(ctx->allocator.user, ptr);
+}
+
+struct gr_ArenaBlock {
+    struct gr_ArenaBlock *next;
+    size_t capacity;
+    size_t used;
+    // Aligns the data following the header
+    _Alignas(GR_ARENA_ALIGN) unsigned char data[];
+};
+
+// Memory is valid until the end of the current step, running out of memory is
+// fatal.
+static void *gr_arena_alloc(gr_RenderContext *ctx, const size_t size)
+{
+    const size_t aligned = gr_align_up(size, GR_ARENA_ALIGN);
+    struct gr_ArenaBlock *head = ctx->scratch.blocks;
+    if (head == NULL || head->capacity - head->used < aligned) {
+        size_t capacity = head == NULL ? GR_ARENA_MIN_BLOCK : head->capacity * 2;
+        if (capacity < aligned) {
+            capacity = aligned;
+        }
+        struct gr_ArenaBlock *block = gr_ctx_malloc(ctx, sizeof(*block) + capacity);
+        if (block == NULL) {
+            fprintf(stderr, "Could not allocate %zu bytes of scratch memory\n", capacity);
+            abort();
+        }
+        block->next = head;
+        block->capacity = capacity;
+        block->used = 0;
+        ctx->scratch.blocks = head = block;
+    }
+    void *ptr = head->data + head->used;
+    head->used += aligned;
+    return ptr;
+}
+
+static void gr_arena_free_blocks(gr_RenderContext *ctx)
+{
+    struct gr_ArenaBlock *block = ctx->scratch.blocks;
+    while (block != NULL) {
+        struct gr_ArenaBlock *next = block->next;
+        gr_ctx_free(ctx, block);
+        block = next;
+    }
+    ctx->scratch.blocks = NULL;
+}
+
+// If the step needed more than one block they are merged into a single one,
+// so the next step with the same demands does not allocate.
+static void gr_arena_reset(gr_RenderContext *ctx)
+{
+    struct gr_ArenaBlock *head = ctx->scratch.blocks;
+    if (head == NULL) {
+        return;
+    }
+    if (head->next != NULL) {
+        size_t capacity = 0;
+        for (struct gr_ArenaBlock *b = head; b != NULL; b = b->next) {
+            capacity += b->capacity;
+        }
+        gr_arena_free_blocks(ctx);
+        head = gr_ctx_malloc(ctx, sizeof(*head) + capacity);
+        if (head == NULL) {
+            return;
+        }
+        head->next = NULL;
+        head->capacity = capacity;
+        ctx->scratch.blocks = head;
+    }
+    head->used = 0;
+}
+
+bool gr_graph_init_ex(gr_Graph *graph, const size_t n_verticies,
+                      const gr_Allocator *allocator)
+{
+    assert(graph != NULL);
+    assert(n_verticies > 0);
+    graph->edges = NULL;
+    if (n_verticies > GR_INDEX_MAX) {
+        return false;
+    }
+    graph->allocator = allocator == NULL ? gr_allocator_default() : *allocator;
+    const gr_Allocator *a = &graph->allocator;
+
+    bool *edges_raw = a->calloc_fn(a->user, n_verticies * n_verticies, sizeof(bool));
+    if (edges_raw == NULL) {
+        return false;
+    }
+    bool **edges = a->calloc_fn(a->user, n_verticies, sizeof(bool*));
+    if (edges == NULL) {
+        a->free_fn(a->user, edges_raw);
+        return false;
+    }
+    gr_Index *component_parent = a->malloc_fn(a->user, n_verticies * sizeof(gr_Index));
+    if (component_parent == NULL) {
+        a->free_fn(a->user, edges);
+        a->free_fn(a->user, edges_raw);
+        return false;
+    }
+    for (size_t i = 0; i < n_verticies; i += 1) {
+        edges[i] = edges_raw + (n_verticies * i);
+        component_parent[i] = i;
+    }
+
+    graph->n_verticies = n_verticies;
+    graph->edges = edges;
+    graph->n_edges = 0;
+    graph->lengths = NULL;
+    graph->n_lengths = 0;
+    graph->lengths_capacity = 0;
+    graph->lengths_version = 0;
+    graph->component_parent = component_parent;
+    return true;
+}
+
+bool gr_graph_init(gr_Graph *graph, const size_t n_verticies)
+{
+    return gr_graph_init_ex(graph, n_verticies, NULL);
+}
+
+void gr_graph_destroy(gr_Graph *graph)
+{
+    assert(graph != NULL);
+    assert(graph->edges != NULL);
+    graph->allocator.free_fn(graph->allocator.user, *graph->edges);
+    graph->allocator.free_fn(graph->allocator.user, graph->edges);
+    graph->allocator.free_fn(graph->allocator.user, graph->component_parent);
+    if (graph->lengths != NULL) {
+        graph->allocator.free_fn(graph->allocator.user, graph->lengths);
+    }
+    graph->edges = NULL;
+    graph->component_parent = NULL;
+    graph->lengths = NULL;
+    return;
+}
+
+static size_t gr_graph_component(const gr_Graph *graph, size_t vertex)
+{
+    while (graph->component_parent[vertex] != vertex) {
+        vertex = graph->component_parent[vertex];
+    }
+    return vertex;
+}
+
+static void gr_graph_join_components(gr_Graph *graph, size_t a, size_t b)
+{
+    gr_Index *parent = graph->component_parent;
+    // path halving keeps the trees flat without a second pass
+    while (parent[a] != a) {
+        parent[a] = parent[parent[a]];
+        a = parent[a];
+    }
+    while (parent[b] != b) {
+        parent[b] = parent[parent[b]];
+        b = parent[b];
+    }
+    if (a < b) {
+        parent[b] = a;
+    } else {
+        parent[a] = b;
+    }
+}
+
+// Makes room for `count` more edge lengths
+static bool gr_graph_reserve_lengths(gr_Graph *graph, const size_t count)
+{
+    if (graph->n_lengths + count <= graph->lengths_capacity) {
+        return true;
+    }
+    size_t capacity = graph->lengths_capacity == 0 ? 16 : graph->lengths_capacity * 2;
+    while (capacity < graph->n_lengths + count) {
+        capacity *= 2;
+    }
+    const gr_Allocator *a = &graph->allocator;
+    gr_EdgeLength *lengths = a->malloc_fn(a->user, capacity * sizeof(gr_EdgeLength));
+    if (lengths == NULL) {
+        return false;
+    }
+    if (graph->lengths != NULL) {
+        memcpy(lengths, graph->lengths, graph->n_lengths * sizeof(gr_EdgeLength));
+        a->free_fn(a->user, graph->lengths);
+    }
+    graph->lengths = lengths;
+    graph->lengths_capacity = capacity;
+    return true;
+}
+
+// Sets the length of the edge from `start` to `end`, `1` removes its entry
+static void gr_graph_set_length(gr_Graph *graph, const size_t start, const size_t end,
+                                const float length)
+{
+    // only an edge which already existed can have an entry
+    if (graph->edges[start][end]) {
+        for (size_t l = 0; l < graph->n_lengths; l += 1) {
+            gr_EdgeLength *entry = &graph->lengths[l];
+            if (entry->start != start || entry->end != end) {
+                continue;
+            }
+            if (length == 1) {
+                *entry = graph->lengths[--graph->n_lengths];
+            } else {
+                entry->length = length;
+            }
+            graph->lengths_version += 1;
+            return;
+        }
+    }
+    if (length != 1) {
+        graph->lengths[graph->n_lengths++] = (gr_EdgeLength) {
+            .start = start, .end = end, .length = length,
+        };
+        graph->lengths_version += 1;
+    }
+}
+
+bool gr_graph_add_edge_ex(gr_Graph *graph, const gr_Edge edge, const float length)
+{
+    assert(graph != NULL);
+    assert(length >= 0);
+    if (edge.start >= graph->n_verticies || edge.end >= graph->n_verticies) {
+        return false;
+    }
+    if (length != 0) {
+        if (!gr_graph_reserve_lengths(graph, 2)) {
+            return false;
+        }
+        gr_graph_set_length(graph, edge.start, edge.end, length);
+        if (!edge.directed) {
+            gr_graph_set_length(graph, edge.end, edge.start, length);
+        }
+    }
+    graph->n_edges += !graph->edges[edge.start][edge.end];
+    graph->edges[edge.start][edge.end] = true;
+    if (!edge.directed) {
+        graph->n_edges += !graph->edges[edge.end][edge.start];
+        graph->edges[edge.end][edge.start] = true;
+    }
+    gr_graph_join_components(graph, edge.start, edge.end);
+    return true;
+}
+
+bool gr_graph_add_edge(gr_Graph *graph, const gr_Edge edge)
+{
+    return gr_graph_add_edge_ex(graph, edge, 0);
+}
+
+size_t gr_graph_add_edges(gr_Graph *graph, const size_t n_edges, const gr_Edge *edges)
+{
+    for (size_t i = 0; i < n_edges; i += 1) {
+        if (!gr_graph_add_edge(graph, edges[i])) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+gr_RenderMethod gr_method_create(const enum gr_RenderMethodKind kind)
+{
+    switch (kind) {
+        case GR_RM_Eades:
+            return (gr_RenderMethod) {
+                .eades = (struct gr_RenderMethodEades) {
+                    .kind = GR_RM_Eades,
+                    .c1 = GR_DEFAULT_EADES_C1,
+                    .c2 = GR_DEFAULT_EADES_C2,
+                    .c3 = GR_DEFAULT_EADES_C3,
+                    .c4 = GR_DEFAULT_EADES_C4,
+                    .grav_cen = GR_DEFAULT_GRAV_CEN,
+                },
+            };
+        case GR_RM_Fruchterman_and_Reingold:
+            return (gr_RenderMethod) {
+                .fruchtgold = (struct gr_RenderMethodFruchtgold) {
+                    .kind = GR_RM_Fruchterman_and_Reingold,
+                    .c = GR_DEFAULT_FRUCHTGOLD_C,
+                    .area = GR_DEFAULT_FRUCHTGOLD_AREA,
+                    .cur_temp = GR_DEFAULT_FRUCHTGOLD_TEMP,
+                    .decay = GR_DEFAULT_FRUCHTGOLD_DECAY(
+                                GR_DEFAULT_FRUCHTGOLD_TEMP,
+                                GR_DEFAULT_ITERATIONS),
+                    .grav_cen = GR_DEFAULT_GRAV_CEN,
+                },
+            };
+        case GR_RM_ForceAtlas2:
+            return (gr_RenderMethod) {
+                .force_atlas = (struct gr_RenderMethodForceAtlas2) {
+                    .kind = GR_RM_ForceAtlas2,
+                    .scaling = GR_DEFAULT_FORCEATLAS2_SCALING,
+                    .gravity = GR_DEFAULT_FORCEATLAS2_GRAVITY,
+                    .tolerance = GR_DEFAULT_FORCEATLAS2_TOLERANCE,
+                    .grav_cen = GR_DEFAULT_GRAV_CEN,
+                },
+            };
+        case GR_RM_SGD:
+            return (gr_RenderMethod) {
+                .sgd = (struct gr_RenderMethodSGD) {
+                    .kind = GR_RM_SGD,
+                    .length = GR_DEFAULT_SGD_LENGTH,
+                    .epsilon = GR_DEFAULT_SGD_EPSILON,
+                    .iterations = GR_DEFAULT_SGD_ITERATIONS,
+                    .pivots = GR_DEFAULT_SGD_PIVOTS,
+                    .grav_cen = GR_DEFAULT_GRAV_CEN,
+                },
+            };
+    default:
+        fprintf(stderr, "Unreachable render method kind: %d\n", kind);
+        abort();
+    }
+}
+
+static void gr_render_state_destroy(gr_RenderContext *ctx);
+
+static void gr_bbox_include(gr_Vec2 *min, gr_Vec2 *max, const gr_Vec2 p)
+{
+    if (p.x < min->x) { min->x = p.x; }
+    if (p.y < min->y) { min->y = p.y; }
+    if (p.x > max->x) { max->x = p.x; }
+    if (p.y > max->y) { max->y = p.y; }
+}
+
+gr_RenderContext gr_render_ctx_create_alloc(const gr_Graph *graph,
+                                            const gr_RenderMethod method,
+                                            const int init_positions,
+                                            const gr_Allocator *allocator)
+{
+    assert(graph != NULL);
+
+    gr_RenderContext ctx = (gr_RenderContext) {
+        .graph = graph,
+        .method = method,
+        .positions_initialized = init_positions != GR_INIT_NONE,
+        .vertex_pos = NULL,
+        .output = { 0 },
+        .cur_iteration = 0,
+        .bbox_min = gr_vec2(FLT_MAX, FLT_MAX),
+        .bbox_max = gr_vec2(-FLT_MAX, -FLT_MAX),
+        .perf = NULL,
+        .allocator = allocator == NULL ? graph->allocator : *allocator,
+        .split_components = false,
+        .prune_leaves = false,
+        .compress_chains = false,
+        .collapse_twins = false,
+        .freeze_threshold = 0,
+        .pinned = NULL,
+        .repulsion_samples = 0,
+        .verlet_cutoff = 0,
+        .fast_math = false,
+        .vertex_order = GR_ORDER_NONE,
+        .n_threads = 1,
+        .scratch = { 0 },
+        .heap_allocs = 0,
+        .state = NULL,
+    };
+
+    if (init_positions != GR_INIT_NONE) {
+        ctx.vertex_pos = gr_ctx_calloc(&ctx, graph->n_verticies, sizeof(gr_Vec2));
+        for (size_t i = 0; i < graph->n_verticies; i += 1) {
+            ctx.vertex_pos[i] = (gr_Vec2) {
+                .x = gr_randf(0, 1),
+                .y = gr_randf(0, 1),
+            };
+            gr_bbox_include(&ctx.bbox_min, &ctx.bbox_max, ctx.vertex_pos[i]);
+        }
+    }
+    if (init_positions == GR_INIT_SPECTRAL) {
+        gr_render_ctx_spectral(&ctx);
+    }
+
+    return ctx;
+}
+
+gr_RenderContext gr_render_ctx_create_ex(const gr_Graph *graph,
+                                         const gr_RenderMethod method,
+                                         const int init_positions)
+{
+    return gr_render_ctx_create_alloc(graph, method, init_positions, NULL);
+}
+
+void gr_render_ctx_destroy(gr_RenderContext *ctx)
+{
+    assert(ctx != NULL);
+    gr_render_state_destroy(ctx);
+    if (ctx->positions_initialized && ctx->vertex_pos != NULL) {
+        gr_ctx_free(ctx, ctx->vertex_pos);
+        ctx->vertex_pos = NULL;
+    }
+    gr_arena_free_blocks(ctx);
+}
+
+void gr_render_ctx_update_bbox(gr_RenderContext *ctx)
+{
+    assert(ctx != NULL);
+    ctx->bbox_min = gr_vec2(FLT_MAX, FLT_MAX);
+    ctx->bbox_max = gr_vec2(-FLT_MAX, -FLT_MAX);
+    for (size_t i = 0; i < ctx->graph->n_verticies; i += 1) {
+        gr_bbox_include(&ctx->bbox_min, &ctx->bbox_max, ctx->vertex_pos[i]);
+    }
+}
+
+static void gr_binding_set(const gr_Binding *binding, const size_t i, const gr_Vec2 p)
+{
+    char *at = (char *)binding->base + i * binding->stride;
+    if (binding->type == GR_BIND_DOUBLE) {
+        const double xy[2] = { p.x, p.y };
+        memcpy(at, xy, sizeof(xy));
+    } else {
+        memcpy(at, &p, sizeof(p));
+    }
+}
+
+static void gr_normalize_bound(const gr_Vec2 *pos, const size_t n, gr_Vec2 min,
+                               gr_Vec2 max, const gr_Vec2 mins, const gr_Vec2 maxs,
+                               const gr_Binding *out)
+{
+    assert(out->base != NULL);
+    assert(mins.x < maxs.x && mins.y < maxs.y);
+
+    if (min.x > max.x) {
+        // positions were set from outside without updating the box
+        for (size_t i = 0; i < n; i += 1) {
+            gr_bbox_include(&min, &max, pos[i]);
+        }
+    }
+
+    for (size_t i = 0; i < n; i += 1) {
+        const gr_Vec2 p = pos[i];
+        gr_binding_set(out, i, gr_vec2(gr_lerpf(p.x, min.x, max.x, mins.x, maxs.x),
+                                       gr_lerpf(p.y, min.y, max.y, mins.y, maxs.y)));
+    }
+}
+
+void gr_render_ctx_normalize_bound_ex(const gr_RenderContext *ctx, const gr_Vec2 mins,
+                                      const gr_Vec2 maxs, const gr_Binding out)
+{
+    assert(ctx != NULL);
+    gr_normalize_bound(ctx->vertex_pos, ctx->graph->n_verticies, ctx->bbox_min,
+                       ctx->bbox_max, mins, maxs, &out);
+}
+
+void gr_render_ctx_normalize_into_ex(const gr_RenderContext *ctx, const gr_Vec2 mins,
+                                     const gr_Vec2 maxs, gr_Vec2 *out)
+{
+    gr_render_ctx_normalize_bound_ex(ctx, mins, maxs,
+                                     gr_binding(out, sizeof(gr_Vec2), GR_BIND_FLOAT));
+}
+
+void gr_render_ctx_normalize_ex(gr_RenderContext *ctx, const gr_Vec2 mins,
+                                const gr_Vec2 maxs)
+{
+    gr_render_ctx_normalize_into_ex(ctx, mins, maxs, ctx->vertex_pos);
+    ctx->bbox_min = mins;
+    ctx->bbox_max = maxs;
+}
+
+static const char *gr_perf_phase_names[GR_PERF_PHASE_COUNT] = {
+    [GR_PERF_STEP]   = "step",
+    [GR_PERF_FORCES] = "forces",
+    [GR_PERF_EXPAND] = "expand",
+    [GR_PERF_PACK]   = "pack",
+};
+
+#ifdef __linux__
+// Opens a counter of the calling thread in the group of `leader`, which
+// starts a new group if it is `-1`
+static int gr_perf_open(const uint32_t type, const uint64_t config, const int leader)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = type;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+}
+#endif // __linux__
+
+bool gr_perf_init(gr_Perf *perf)
+{
+    assert(perf != NULL);
+    memset(perf, 0, sizeof(*perf));
+    bool any_open = false;
+    for (size_t c = 0; c < GR_PERF_COUNTER_COUNT; c += 1) {
+        perf->fds[c] = -1;
+    }
+#ifdef __linux__
+    static const uint64_t configs[GR_PERF_COUNTER_COUNT] = {
+        [GR_PERF_CYCLES]        = PERF_COUNT_HW_CPU_CYCLES,
+        [GR_PERF_INSTRUCTIONS]  = PERF_COUNT_HW_INSTRUCTIONS,
+        [GR_PERF_CACHE_MISSES]  = PERF_COUNT_HW_CACHE_MISSES,
+        [GR_PERF_BRANCH_MISSES] = PERF_COUNT_HW_BRANCH_MISSES,
+    };
+    // the first counter which opens leads the group of the others
+    int leader = -1;
+    for (size_t c = 0; c < GR_PERF_COUNTER_COUNT; c += 1) {
+        perf->fds[c] = gr_perf_open(PERF_TYPE_HARDWARE, configs[c], leader);
+        if (perf->fds[c] < 0) {
+            perf->fds[c] = -1;
+            if (perf->error == 0) {
+                perf->error = errno;
+            }
+        } else {
+            leader = leader < 0 ? perf->fds[c] : leader;
+            any_open = true;
+        }
+    }
+#else
+    perf->error = ENOSYS;
+#endif // __linux__
+    return any_open;
+}
+
+void gr_perf_destroy(gr_Perf *perf)
+{
+    assert(perf != NULL);
+#ifdef __linux__
+    for (size_t c = 0; c < GR_PERF_COUNTER_COUNT; c += 1) {
+        if (perf->fds[c] >= 0) {
+            close(perf->fds[c]);
+        }
+        perf->fds[c] = -1;
+    }
+#endif // __linux__
+}
+
+void gr_perf_reset(gr_Perf *perf)
+{
+    assert(perf != NULL);
+    perf->steps = 0;
+    perf->max_threads = 0;
+    memset(perf->values, 0, sizeof(perf->values));
+    memset(perf->pairs, 0, sizeof(perf->pairs));
+}
+
+// Reads all counters at once from the group leader, which lists the values
+// in the order the counters were opened
+static void gr_perf_read(const gr_Perf *perf, uint64_t values[GR_PERF_COUNTER_COUNT])
+{
+    memset(values, 0, GR_PERF_COUNTER_COUNT * sizeof(values[0]));
+#ifdef __linux__
+    size_t leader = 0;
+    while (leader < GR_PERF_COUNTER_COUNT && perf->fds[leader] < 0) {
+        leader += 1;
+    }
+    if (leader == GR_PERF_COUNTER_COUNT) {
+        return;
+    }
+    uint64_t group[1 + GR_PERF_COUNTER_COUNT];
+    const ssize_t size = read(perf->fds[leader], group, sizeof(group));
+    if (size < (ssize_t)sizeof(group[0]) ||
+        (size_t)size < (1 + group[0]) * sizeof(group[0])) {
+        return;
+    }
+    size_t i = 1;
+    for (size_t c = 0; c < GR_PERF_COUNTER_COUNT && i <= group[0]; c += 1) {
+        if (perf->fds[c] >= 0) {
+            values[c] = group[i];
+            i += 1;
+        }
+    }
+#else
+    (void)perf;
+#endif // __linux__
+}
+
+static void gr_perf_begin(gr_Perf *perf, const enum gr_PerfPhase phase)
+{
+    if (perf == NULL) {
+        return;
+    }
+    gr_perf_read(perf, perf->begin[phase]);
+}
+
+static void gr_perf_end(gr_Perf *perf, const enum gr_PerfPhase phase,
+                        const uint64_t pairs)
+{
+    if (perf == NULL) {
+        return;
+    }
+    uint64_t now[GR_PERF_COUNTER_COUNT];
+    gr_perf_read(perf, now);
+    for (size_t c = 0; c < GR_PERF_COUNTER_COUNT; c += 1) {
+        perf->values[phase][c] += now[c] - perf->begin[phase][c];
+    }
+    perf->pairs[phase] += pairs;
+}
+
+void gr_perf_report(const gr_Perf *perf, FILE *stream)
+{
+    assert(perf != NULL);
+    assert(stream != NULL);
+
+    bool any_open = false;
+    for (size_t c = 0; c < GR_PERF_COUNTER_COUNT; c += 1) {
+        any_open |= perf->fds[c] >= 0;
+    }
+    if (!any_open) {
+        fprintf(stream, "gray perf counters: unavailable (%s)\n", strerror(perf->error));
+        return;
+    }
+
+    fprintf(stream, "gray perf counters over %llu steps:\n",
+            (unsigned long long)perf->steps);
+    // the workers are not counted, but their pairs are
+    const bool per_pair = perf->max_threads <= 1;
+    if (!per_pair) {
+        fprintf(stream, "only the calling thread of %zu is counted, no values per pair\n",
+                perf->max_threads);
+    }
+    fprintf(stream, "%-8s %14s %14s %6s %14s %14s %14s %12s %12s\n",
+            "phase", "cycles", "instructions", "IPC", "cache-misses",
+            "branch-misses", "pairs", "cm/pair", "bm/pair");
+    for (size_t p = 0; p < GR_PERF_PHASE_COUNT; p += 1) {
+        const uint64_t *v = perf->values[p];
+        const double pairs = perf->pairs[p] == 0 ? 1 : (double)perf->pairs[p];
+        char cells[GR_PERF_COUNTER_COUNT][32];
+        for (size_t c = 0; c < GR_PERF_COUNTER_COUNT; c += 1) {
+            if (perf->fds[c] >= 0) {
+                snprintf(cells[c], sizeof(cells[c]), "%llu", (unsigned long long)v[c]);
+            } else {
+                snprintf(cells[c], sizeof(cells[c]), "unavailable");
+            }
+        }
+        char ipc[16] = "unavailable";
+        if (perf->fds[GR_PERF_CYCLES] >= 0 && perf->fds[GR_PERF_INSTRUCTIONS] >= 0) {
+            const double cycles = v[GR_PERF_CYCLES] == 0 ? 1 : (double)v[GR_PERF_CYCLES];
+            snprintf(ipc, sizeof(ipc), "%.2f", (double)v[GR_PERF_INSTRUCTIONS] / cycles);
+        }
+        char cm_pair[32] = "unavailable";
+        char bm_pair[32] = "unavailable";
+        if (!per_pair) {
+            snprintf(cm_pair, sizeof(cm_pair), "-");
+            snprintf(bm_pair, sizeof(bm_pair), "-");
+        }
+        if (per_pair && perf->fds[GR_PERF_CACHE_MISSES] >= 0) {
+            snprintf(cm_pair, sizeof(cm_pair), "%.4f", (double)v[GR_PERF_CACHE_MISSES] / pairs);
+        }
+        if (per_pair && perf->fds[GR_PERF_BRANCH_MISSES] >= 0) {
+            snprintf(bm_pair, sizeof(bm_pair), "%.4f", (double)v[GR_PERF_BRANCH_MISSES] / pairs);
+        }
+        fprintf(stream, "%-8s %14s %14s %6s %14s %14s %14llu %12s %12s\n",
+                gr_perf_phase_names[p], cells[GR_PERF_CYCLES],
+                cells[GR_PERF_INSTRUCTIONS], ipc, cells[GR_PERF_CACHE_MISSES],
+                cells[GR_PERF_BRANCH_MISSES], (unsigned long long)perf->pairs[p],
+                cm_pair, bm_pair);
+    }
+}
+
+typedef void (*gr_TaskFn)(void *arg, size_t task, size_t thread);
+
+// Only defined with threads, render states keep a `NULL` pointer without
+struct gr_ThreadPool;
+
+#ifndef GR_NO_THREADS
+// Fixed set of worker threads created by the first step. The calling thread
+// takes part in every job as thread `0`.
+struct gr_ThreadPool {
+    size_t n_workers;
+    pthread_t *threads;
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    size_t generation;
+    size_t running;
+    bool stop;
+
+    gr_TaskFn fn;
+    void *arg;
+    size_t n_tasks;
+    atomic_size_t next_task;
+};
+
+typedef struct {
+    struct gr_ThreadPool *pool;
+    size_t thread;
+} gr_WorkerArg;
+
+static void gr_pool_work(struct gr_ThreadPool *pool, const size_t thread)
+{
+    for (;;) {
+        const size_t task = atomic_fetch_add(&pool->next_task, 1);
+        if (task >= pool->n_tasks) {
+            break;
+        }
+        pool->fn(pool->arg, task, thread);
+    }
+}
+
+static void *gr_pool_worker(void *arg)
+{
+    struct gr_ThreadPool *pool = ((gr_WorkerArg *)arg)->pool;
+    const size_t thread = ((gr_WorkerArg *)arg)->thread;
+    size_t seen = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        while (!pool->stop && pool->generation == seen) {
+            pthread_cond_wait(&pool->start, &pool->mutex);
+        }
+        if (pool->stop) {
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->mutex);
+
+        gr_pool_work(pool, thread);
+
+        pthread_mutex_lock(&pool->mutex);
+        pool->running -= 1;
+        if (pool->running == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+#endif // GR_NO_THREADS
+
+// Runs `fn` for every task, the tasks are distributed over the pool (if any)
+// and the calling thread. Returns after all tasks are done.
+static void gr_pool_run(struct gr_ThreadPool *pool, gr_TaskFn fn, void *arg,
+                        const size_t n_tasks)
+{
+#ifndef GR_NO_THREADS
+    if (pool != NULL && n_tasks > 1) {
+        pthread_mutex_lock(&pool->mutex);
+        pool->fn = fn;
+        pool->arg = arg;
+        pool->n_tasks = n_tasks;
+        atomic_store(&pool->next_task, 0);
+        pool->running = pool->n_workers;
+        pool->generation += 1;
+        pthread_cond_broadcast(&pool->start);
+        pthread_mutex_unlock(&pool->mutex);
+
+        gr_pool_work(pool, 0);
+
+        pthread_mutex_lock(&pool->mutex);
+        while (pool->running > 0) {
+            pthread_cond_wait(&pool->done, &pool->mutex);
+        }
+        pthread_mutex_unlock(&pool->mutex);
+        return;
+    }
+#else
+    (void)pool;
+#endif // GR_NO_THREADS
+    for (size_t task = 0; task < n_tasks; task += 1) {
+        fn(arg, task, 0);
+    }
+}
+
+#ifdef GR_TILING
+#ifdef __linux__
+static bool gr_read_cache_info(const int index, const char *name, char *buf, const size_t size)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/%s", index, name);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+    const bool read = fgets(buf, (int)size, file) != NULL;
+    fclose(file);
+    return read;
+}
+#endif // __linux__
+
+// Size of the level 1 or 2 data cache in bytes, `fallback` if it is unknown
+static size_t gr_cache_size(const int level, const size_t fallback)
+{
+#if defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE)
+    const long size = sysconf(level == 1 ? _SC_LEVEL1_DCACHE_SIZE : _SC_LEVEL2_CACHE_SIZE);
+    if (size > 0) {
+        return (size_t)size;
+    }
+#endif // _SC_LEVEL1_DCACHE_SIZE
+#ifdef __linux__
+    // containers often hide it from sysconf, but not from sysfs
+    char buf[32];
+    for (int index = 0; gr_read_cache_info(index, "level", buf, sizeof(buf)); index += 1) {
+        if (atoi(buf) != level ||
+            !gr_read_cache_info(index, "type", buf, sizeof(buf)) ||
+            strncmp(buf, "Instruction", 11) == 0 ||
+            !gr_read_cache_info(index, "size", buf, sizeof(buf))) {
+            continue;
+        }
+        char *unit = NULL;
+        const size_t size = strtoul(buf, &unit, 10);
+        return size * (*unit == 'K' ? 1024 : *unit == 'M' ? 1024 * 1024 : 1);
+    }
+#endif // __linux__
+    return fallback;
+}
+#endif // GR_TILING
+
+// Kernels are written once with compile time options and inlined into a
+// function per combination of them, see `GR_KERNEL`
+#if defined(__GNUC__) || defined(__clang__)
+#   define GR_TEMPLATE static inline __attribute__((always_inline))
+#else
+#   define GR_TEMPLATE static inline
+#endif // __GNUC__
+
+enum {
+    // verticies carry a mass
+    GR_KERNEL_WEIGHTED  = 1 << 0,
+    // `fast_math` of the context
+    GR_KERNEL_FAST_MATH = 1 << 1,
+    // LinLog attraction of ForceAtlas2
+    GR_KERNEL_LIN_LOG   = 1 << 2,
+};
+
+// Approximations for `fast_math` without branches or library calls, so the
+// loops using them vectorize. For positive normal floats the relative error
+// of `gr_approx_rsqrt` is below 1.8e-3 (one Newton step), of `gr_approx_rcp`
+// below 7e-6 (two Newton steps, it works for negative ones as well) and the
+// absolute error of `gr_approx_log` below 2e-6.
+static inline float gr_approx_rsqrt(const float x)
+{
+    uint32_t i;
+    memcpy(&i, &x, sizeof(i));
+    i = 0x5f375a86u - (i >> 1);
+    float r;
+    memcpy(&r, &i, sizeof(r));
+    return r * (1.5f - 0.5f * x * r * r);
+}
+
+static inline float gr_approx_rcp(const float x)
+{
+    uint32_t i;
+    memcpy(&i, &x, sizeof(i));
+    i = 0x7ef311c3u - i;
+    float r;
+    memcpy(&r, &i, sizeof(r));
+    r = r * (2 - x * r);
+    return r * (2 - x * r);
+}
+
+static inline float gr_approx_log(const float x)
+{
+    // x = 2^e * m with m in [sqrt(1/2), sqrt(2))
+    uint32_t i;
+    memcpy(&i, &x, sizeof(i));
+    int e = (int)(i >> 23) - 127;
+    i = (i & 0x007fffffu) | 0x3f800000u;
+    float m;
+    memcpy(&m, &i, sizeof(m));
+    const bool high = m > 1.41421356f;
+    m = high ? 0.5f * m : m;
+    e += high;
+    // log(m) = 2 atanh(t) with |t| < 0.172, the series is cut after t^7
+    const float t  = (m - 1) * gr_approx_rcp(m + 1);
+    const float t2 = t * t;
+    return (float)e * 0.693147181f +
+           2 * t * (1 + t2 * (1.0f / 3 + t2 * (1.0f / 5 + t2 * (1.0f / 7))));
+}
+
+// With `fast` the distance comes from `inv_d = gr_frsqrt(d_sq, fast)`, which
+// then replaces the divisions by it. Like `gr_not0f` coincident verticies get
+// a tiny distance instead of zero, but without a branch.
+GR_TEMPLATE float gr_frsqrt(const float d_sq, const bool fast)
+{
+    return fast ? gr_approx_rsqrt(d_sq + 1e-24f) : 0;
+}
+
+GR_TEMPLATE float gr_fdist(const float d_sq, const float inv_d, const bool fast)
+{
+    return gr_not0f(fast ? d_sq * inv_d : sqrtf(d_sq));
+}
+
+GR_TEMPLATE float gr_fdiv_d(const float a, const float d, const float inv_d, const bool fast)
+{
+    return fast ? a * inv_d : a / d;
+}
+
+GR_TEMPLATE float gr_fdiv_d_sq(const float a, const float d, const float inv_d, const bool fast)
+{
+    return fast ? a * inv_d * inv_d : a / gr_sq(d);
+}
+
+GR_TEMPLATE float gr_fdiv(const float a, const float b, const bool fast)
+{
+    return fast ? a * gr_approx_rcp(b) : a / b;
+}
+
+GR_TEMPLATE float gr_flog(const float x, const bool fast)
+{
+    return fast ? gr_approx_log(x) : logf(x);
+}
+
+// With `fast_math` this many sources are summed side by side, the compiler
+// turns them into vector lanes as every lane keeps its own sum
+#define GR_LANES 8
+
+// Positions `[start, start + count)` are laid out independently of all others
+typedef struct {
+    size_t start;
+    size_t count;
+    // Number of verticies whose forces were calculated in the last step
+    size_t active;
+    // Bounding box of the block after the last step, updated by the kernels
+    // and the placement of the verticies depending on the block
+    gr_Vec2 min;
+    gr_Vec2 max;
+    // Global speed of ForceAtlas2
+    float speed;
+    // Distance up to which the neighbor lists of the block were built, `0`
+    // if they were not built yet, and how far a vertex may move before they
+    // have to be rebuilt
+    float verlet_reach;
+    float verlet_slack;
+    // Whether the exact repulsion of the current step evaluates every pair
+    // only once, see `gr_block_symmetric`
+    bool symmetric;
+    // Whether the block contains a pinned vertex. Its offset is never changed
+    // by the packing then, or the vertex would move with it.
+    bool pinned;
+} gr_Block;
+
+// Children of one vertex which were removed by leaf pruning. They are placed
+// around their parent after every step.
+typedef struct {
+    // Slot of the parent and the first of the `count` consecutive child slots
+    size_t parent;
+    size_t first;
+    size_t count;
+    size_t block;
+    // Slots the children are turned away from and pushed off: the grandparent
+    // if the parent was pruned as well, otherwise some of the laid out neighbors
+    size_t ref_first;
+    size_t ref_count;
+    // Number of laid out neighbors of a laid out parent
+    size_t parent_degree;
+    bool parent_pruned;
+} gr_LeafGroup;
+
+// Inner verticies of a contracted path between the slots `a` and `b`. They
+// occupy `count` consecutive slots starting at `first`, ordered from `a` to `b`.
+typedef struct {
+    size_t a;
+    size_t b;
+    size_t first;
+    size_t count;
+    size_t block;
+    // Sum of the lengths of the contracted edges
+    float length;
+} gr_Chain;
+
+// Verticies with the same neighbors as the laid out vertex in slot `rep`. They
+// occupy `count` consecutive slots starting at `first`.
+typedef struct {
+    size_t rep;
+    size_t first;
+    size_t count;
+    size_t block;
+} gr_TwinClass;
+
+// Term of the stress between the slots `i` and `j` which should be `d` edge
+// lengths apart. `w_i` and `w_j` weight how far each of them moves, a side
+// with weight 0 stays put and the other one covers the whole distance.
+typedef struct {
+    gr_Index i;
+    gr_Index j;
+    float d;
+    float w_i;
+    float w_j;
+} gr_StressTerm;
+
+// Size of a component (or the work of a block) for sorting, largest first
+typedef struct {
+    size_t count;
+    size_t component;
+} gr_ComponentSize;
+
+// Calculates the forces on the verticies of a block and moves them
+typedef void (*gr_Kernel)(const gr_RenderMethod *method, const gr_Graph *graph,
+                          struct gr_RenderState *state, gr_Block *block);
+
+struct gr_RenderState {
+    // What the state was derived from, a change requires a new state
+    bool split_components;
+    bool prune_leaves;
+    bool compress_chains;
+    bool collapse_twins;
+    bool freeze;
+    bool sampling;
+    bool verlet;
+    enum gr_RenderMethodKind kind;
+    enum gr_VertexOrder order;
+    size_t sgd_pivots;
+    const uint64_t *pinned;
+    size_t n_threads;
+    size_t n_edges;
+    size_t lengths_version;
+    const gr_Vec2 *vertex_pos;
+
+    // Number of laid out verticies. They occupy the first slots, the slots
+    // after them belong to verticies which are placed relative to them:
+    // first collapsed twins, then the inner verticies of contracted chains and
+    // last pruned leaves.
+    size_t n;
+    // Graph vertex of every slot
+    gr_Index *ids;
+    // Positions of all slots. Points to `vertex_pos` if `ids` is the identity
+    // and no translation is necessary.
+    gr_Vec2 *pos;
+
+    size_t n_blocks;
+    gr_Block *blocks;
+    // Verticies per tile of the exact repulsion: sources which stay in the L1
+    // cache while a tile of targets, which stays in the L2 cache, is pushed
+    // by them. Blocks with no more than `tile_cols` verticies are not tiled,
+    // without `GR_TILING` none are.
+    size_t tile_rows;
+    size_t tile_cols;
+    // Translation from the local frame of each block into `vertex_pos`,
+    // `NULL` if the blocks are not packed
+    gr_Vec2 *offsets;
+    // Number of graph verticies every laid out slot stands for, `NULL` if
+    // every slot stands for itself
+    float *mass;
+
+    // Springs between laid out verticies whose ideal length differs from the
+    // one of the render method: edges with a length other than 1 and the
+    // contracted chains. One list per laid out vertex, `spring_lengths` scales
+    // the ideal length. Exactly one spring of every pair of verticies has
+    // `spring_cancels` set, it takes back what the all pairs loop of the
+    // kernels did for that pair. `NULL` if there are none.
+    size_t *spring_offsets;
+    gr_Index *springs;
+    float *spring_lengths;
+    bool *spring_cancels;
+
+    size_t n_twin_classes;
+    gr_TwinClass *twin_classes;
+
+    size_t n_chains;
+    gr_Chain *chains;
+
+    size_t n_leaf_groups;
+    gr_LeafGroup *leaf_groups;
+    gr_Index *leaf_refs;
+
+    // Stress terms of `GR_RM_SGD`, shuffled before every step
+    size_t n_terms;
+    gr_StressTerm *terms;
+    // Step sizes at the start and the end of the annealing schedule
+    float eta_max;
+    float eta_min;
+    uint64_t seed;
+
+    // Degree plus one of every laid out vertex for `GR_RM_ForceAtlas2`, and
+    // its forces of the current and the last step. The other methods keep
+    // the repulsion of a tile in `forces`.
+    float *degrees;
+    gr_Vec2 *forces;
+    gr_Vec2 *prev_forces;
+    // `n_threads` arrays of `n` forces, the shares of the repulsion of a
+    // single block calculated by the threads of the pool. `NULL` unless
+    // ForceAtlas2 runs with multiple threads on one block.
+    gr_Vec2 *partial_forces;
+
+    // Kernel of the current step and the `GR_KERNEL_*` options it was
+    // instantiated for
+    gr_Kernel kernel;
+    unsigned options;
+    // Copy of `freeze_threshold` of the context for the current step
+    float freeze_threshold;
+    // Copy of `repulsion_samples` of the context and the number of the
+    // current step, which seeds the samples
+    size_t samples;
+    size_t step;
+    // Laid out verticies every laid out vertex has an edge to, for the
+    // attraction. `NULL` for `GR_RM_SGD`.
+    size_t *edge_offsets;
+    gr_Index *edge_targets;
+
+    // Copy of `verlet_cutoff` of the context for the current step
+    float verlet_cutoff;
+    // Up to `GR_VERLET_NEIGHBORS` verticies near every laid out vertex in
+    // `verlet_lists[n * GR_VERLET_NEIGHBORS..]`, and its position when the
+    // list was built. `NULL` without neighbor lists.
+    size_t *verlet_counts;
+    gr_Index *verlet_lists;
+    gr_Vec2 *verlet_ref;
+    // Grid the lists are built from, every block has `2 * count + 1` cells
+    // starting at `cell_heads[2 * start + b]`, `cell_next` links the slots
+    gr_Index *cell_heads;
+    gr_Index *cell_next;
+    // Number of consecutive steps every laid out vertex moved less than the
+    // threshold, it is frozen at `GR_FREEZE_STEPS`. `NULL` without freezing.
+    size_t *calm;
+    // Laid out neighbors of every laid out vertex, the ones woken up by it
+    size_t *neighbor_offsets;
+    gr_Index *neighbors;
+
+    struct gr_ThreadPool *pool;
+    // Order in which the blocks are handed to the threads, the ones with the
+    // most work on movable verticies first. `NULL` without a pool.
+    size_t *block_order;
+    gr_ComponentSize *block_work;
+#ifndef GR_NO_THREADS
+    gr_WorkerArg *worker_args;
+#endif // GR_NO_THREADS
+};
+
+static bool gr_is_pinned(const uint64_t *pinned, const size_t v)
+{
+    return pinned != NULL && gr_bitmap_get(pinned, v);
+}
+
+static void *gr_ctx_calloc_or_die(gr_RenderContext *ctx, const size_t count,
+                                  const size_t size)
+{
+    void *ptr = gr_ctx_calloc(ctx, count, size);
+    if (ptr == NULL) {
+        fprintf(stderr, "Could not allocate %zu bytes for the render state\n",
+                count * size);
+        abort();
+    }
+    return ptr;
+}
+
+static void gr_pool_create(gr_RenderContext *ctx, const size_t n_threads)
+{
+#ifndef GR_NO_THREADS
+    struct gr_RenderState *state = ctx->state;
+    if (n_threads <= 1) {
+        return;
+    }
+    struct gr_ThreadPool *pool = gr_ctx_calloc_or_die(ctx, 1, sizeof(*pool));
+    pool->threads = gr_ctx_calloc_or_die(ctx, n_threads - 1, sizeof(pthread_t));
+    state->worker_args = gr_ctx_calloc_or_die(ctx, n_threads - 1, sizeof(gr_WorkerArg));
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    atomic_init(&pool->next_task, 0);
+    for (size_t t = 0; t < n_threads - 1; t += 1) {
+        state->worker_args[t] = (gr_WorkerArg) { .pool = pool, .thread = t + 1 };
+        if (pthread_create(&pool->threads[t], NULL, gr_pool_worker,
+                           &state->worker_args[t]) != 0) {
+            // continue with the threads we got
+            break;
+        }
+        pool->n_workers += 1;
+    }
+    state->pool = pool;
+#else
+    (void)ctx;
+    (void)n_threads;
+#endif // GR_NO_THREADS
+}
+
+static void gr_pool_destroy(gr_RenderContext *ctx)
+{
+#ifndef GR_NO_THREADS
+    struct gr_ThreadPool *pool = ctx->state->pool;
+    if (pool == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+    for (size_t t = 0; t < pool->n_workers; t += 1) {
+        pthread_join(pool->threads[t], NULL);
+    }
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    gr_ctx_free(ctx, pool->threads);
+    gr_ctx_free(ctx, pool);
+    gr_ctx_free(ctx, ctx->state->worker_args);
+    ctx->state->pool = NULL;
+#else
+    (void)ctx;
+#endif // GR_NO_THREADS
+}
+
+static void gr_render_state_destroy(gr_RenderContext *ctx)
+{
+    struct gr_RenderState *state = ctx->state;
+    if (state == NULL) {
+        return;
+    }
+    gr_pool_destroy(ctx);
+    // `ctx->vertex_pos` may point somewhere else by now
+    if (state->pos != state->vertex_pos) {
+        gr_ctx_free(ctx, state->pos);
+    }
+    gr_ctx_free(ctx, state->ids);
+    gr_ctx_free(ctx, state->blocks);
+    gr_ctx_free(ctx, state->offsets);
+    gr_ctx_free(ctx, state->mass);
+    gr_ctx_free(ctx, state->twin_classes);
+    gr_ctx_free(ctx, state->spring_offsets);
+    gr_ctx_free(ctx, state->springs);
+    gr_ctx_free(ctx, state->spring_lengths);
+    gr_ctx_free(ctx, state->spring_cancels);
+    gr_ctx_free(ctx, state->chains);
+    gr_ctx_free(ctx, state->leaf_groups);
+    gr_ctx_free(ctx, state->leaf_refs);
+    gr_ctx_free(ctx, state->terms);
+    gr_ctx_free(ctx, state->degrees);
+    gr_ctx_free(ctx, state->forces);
+    gr_ctx_free(ctx, state->prev_forces);
+    gr_ctx_free(ctx, state->partial_forces);
+    gr_ctx_free(ctx, state->calm);
+    gr_ctx_free(ctx, state->neighbor_offsets);
+    gr_ctx_free(ctx, state->edge_offsets);
+    gr_ctx_free(ctx, state->edge_targets);
+    gr_ctx_free(ctx, state->verlet_counts);
+    gr_ctx_free(ctx, state->verlet_lists);
+    gr_ctx_free(ctx, state->verlet_ref);
+    gr_ctx_free(ctx, state->cell_heads);
+    gr_ctx_free(ctx, state->cell_next);
+    gr_ctx_free(ctx, state->neighbors);
+    gr_ctx_free(ctx, state->block_order);
+    gr_ctx_free(ctx, state->block_work);
+    gr_ctx_free(ctx, state);
+    ctx->state = NULL;
+}
+
+// Undirected adjacency of the graph in compressed sparse row format, edge
+// directions and self loops are ignored
+typedef struct {
+    size_t *offsets;
+    gr_Index *neighbors;
+    // Length of the edge to every neighbor, parallel to `neighbors`. The
+    // length of the edge leaving the vertex wins over the one entering it.
+    // `NULL` if all edges have length 1.
+    float *lengths;
+} gr_Adjacency;
+
+// Lives in the scratch arena
+static gr_Adjacency gr_graph_adjacency(gr_RenderContext *ctx)
+{
+    const gr_Graph *graph = ctx->graph;
+    const size_t n = graph->n_verticies;
+    gr_Adjacency adj = {
+        .offsets = gr_arena_alloc(ctx, (n + 1) * sizeof(size_t)),
+        // every edge shows up at most twice
+        .neighbors = gr_arena_alloc(ctx, 2 * graph->n_edges * sizeof(gr_Index) + 1),
+    };
+
+    // indices into `graph->lengths` touching every vertex and the lengths of
+    // the current row
+    size_t *length_offsets = NULL;
+    size_t *length_entries = NULL;
+    float *row_lengths = NULL;
+    if (graph->n_lengths > 0) {
+        adj.lengths = gr_arena_alloc(ctx, 2 * graph->n_edges * sizeof(float) + 1);
+        length_offsets = gr_arena_alloc(ctx, (n + 1) * sizeof(size_t));
+        length_entries = gr_arena_alloc(ctx, 2 * graph->n_lengths * sizeof(size_t));
+        row_lengths = gr_arena_alloc(ctx, n * sizeof(float));
+        memset(length_offsets, 0, (n + 1) * sizeof(size_t));
+        for (size_t v = 0; v < n; v += 1) {
+            row_lengths[v] = 1;
+        }
+        for (size_t l = 0; l < graph->n_lengths; l += 1) {
+            length_offsets[graph->lengths[l].start + 1] += 1;
+            length_offsets[graph->lengths[l].end + 1] += 1;
+        }
+        for (size_t v = 0; v < n; v += 1) {
+            length_offsets[v + 1] += length_offsets[v];
+        }
+        size_t *fill = gr_arena_alloc(ctx, n * sizeof(size_t));
+        memcpy(fill, length_offsets, n * sizeof(size_t));
+        for (size_t l = 0; l < graph->n_lengths; l += 1) {
+            length_entries[fill[graph->lengths[l].start]++] = l;
+            length_entries[fill[graph->lengths[l].end]++] = l;
+        }
+    }
+
+    size_t count = 0;
+    for (size_t v = 0; v < n; v += 1) {
+        if (row_lengths != NULL) {
+            // edges entering `v` first, so the ones leaving it win
+            for (size_t f = length_offsets[v]; f < length_offsets[v + 1]; f += 1) {
+                const gr_EdgeLength *l = &graph->lengths[length_entries[f]];
+                if (l->end == v) {
+                    row_lengths[l->start] = l->length;
+                }
+            }
+            for (size_t f = length_offsets[v]; f < length_offsets[v + 1]; f += 1) {
+                const gr_EdgeLength *l = &graph->lengths[length_entries[f]];
+                if (l->start == v) {
+                    row_lengths[l->end] = l->length;
+                }
+            }
+        }
+        adj.offsets[v] = count;
+        for (size_t u = 0; u < n; u += 1) {
+            if (u != v && (graph->edges[v][u] || graph->edges[u][v])) {
+                adj.neighbors[count] = u;
+                if (adj.lengths != NULL) {
+                    adj.lengths[count] = row_lengths[u];
+                }
+                count += 1;
+            }
+        }
+        if (row_lengths != NULL) {
+            for (size_t f = length_offsets[v]; f < length_offsets[v + 1]; f += 1) {
+                const gr_EdgeLength *l = &graph->lengths[length_entries[f]];
+                row_lengths[l->start] = 1;
+                row_lengths[l->end] = 1;
+            }
+        }
+    }
+    adj.offsets[n] = count;
+    return adj;
+}
+
+// Computes the 2-core by repeatedly removing verticies of degree one. Every
+// removed vertex gets the neighbor it was attached to as `parent`. One vertex
+// of every tree component is kept, as well as all pinned verticies.
+static void gr_prune_leaves(gr_RenderContext *ctx, const gr_Adjacency *adj,
+                            bool *pruned, size_t *parent)
+{
+    const size_t n = ctx->graph->n_verticies;
+    size_t *degree = gr_arena_alloc(ctx, n * sizeof(size_t));
+    size_t *queue = gr_arena_alloc(ctx, n * sizeof(size_t));
+    size_t head = 0;
+    size_t tail = 0;
+
+    for (size_t v = 0; v < n; v += 1) {
+        degree[v] = adj->offsets[v + 1] - adj->offsets[v];
+        if (degree[v] == 1 && !gr_is_pinned(ctx->pinned, v)) {
+            queue[tail++] = v;
+        }
+    }
+    while (head < tail) {
+        const size_t v = queue[head++];
+        if (degree[v] == 0) {
+            // last vertex of a tree
+            continue;
+        }
+        size_t p = SIZE_MAX;
+        for (size_t e = adj->offsets[v]; e < adj->offsets[v + 1]; e += 1) {
+            if (!pruned[adj->neighbors[e]]) {
+                p = adj->neighbors[e];
+                break;
+            }
+        }
+        assert(p != SIZE_MAX);
+        pruned[v] = true;
+        parent[v] = p;
+        degree[v] = 0;
+        degree[p] -= 1;
+        if (degree[p] == 1 && !gr_is_pinned(ctx->pinned, p)) {
+            queue[tail++] = p;
+        }
+    }
+}
+
+static int gr_component_size_cmp(const void *a, const void *b)
+{
+    const gr_ComponentSize *l = a;
+    const gr_ComponentSize *r = b;
+    // largest first, so the big components start first on the threads
+    if (l->count != r->count) {
+        return l->count > r->count ? -1 : 1;
+    }
+    return l->component < r->component ? -1 : (l->component > r->component);
+}
+
+// Puts the laid out verticies (all without `skip`) into the first slots, one
+// block per connected component ordered by size if `split`, otherwise into a
+// single block.
+static void gr_render_state_make_blocks(gr_RenderContext *ctx, const bool *skip,
+                                        const bool split)
+{
+    struct gr_RenderState *state = ctx->state;
+    const gr_Graph *graph = ctx->graph;
+    const size_t n = graph->n_verticies;
+
+    if (!split) {
+        state->n_blocks = 1;
+        state->blocks = gr_ctx_calloc_or_die(ctx, 1, sizeof(gr_Block));
+        size_t count = 0;
+        for (size_t v = 0; v < n; v += 1) {
+            if (skip == NULL || !skip[v]) {
+                state->ids[count] = v;
+                count += 1;
+            }
+        }
+        state->blocks[0] = (gr_Block) { .start = 0, .count = count };
+        state->n = count;
+        return;
+    }
+
+    size_t *block_of = gr_arena_alloc(ctx, n * sizeof(size_t));
+    size_t *fill = gr_arena_alloc(ctx, n * sizeof(size_t));
+    gr_ComponentSize *sizes = gr_arena_alloc(ctx, n * sizeof(gr_ComponentSize));
+
+    size_t n_blocks = 0;
+    for (size_t v = 0; v < n; v += 1) {
+        block_of[v] = SIZE_MAX;
+    }
+    for (size_t v = 0; v < n; v += 1) {
+        if (skip != NULL && skip[v]) {
+            continue;
+        }
+        const size_t root = gr_graph_component(graph, v);
+        if (block_of[root] == SIZE_MAX) {
+            sizes[n_blocks] = (gr_ComponentSize) { .count = 0, .component = n_blocks };
+            block_of[root] = n_blocks;
+            n_blocks += 1;
+        }
+        block_of[v] = block_of[root];
+        sizes[block_of[v]].count += 1;
+    }
+    qsort(sizes, n_blocks, sizeof(*sizes), gr_component_size_cmp);
+
+    state->n_blocks = n_blocks;
+    state->blocks = gr_ctx_calloc_or_die(ctx, n_blocks, sizeof(gr_Block));
+    size_t start = 0;
+    for (size_t b = 0; b < n_blocks; b += 1) {
+        state->blocks[b] = (gr_Block) { .start = start, .count = sizes[b].count };
+        // `fill` maps the component to its block while placing the verticies
+        fill[sizes[b].component] = b;
+        start += sizes[b].count;
+    }
+    for (size_t b = 0; b < n_blocks; b += 1) {
+        sizes[b].count = 0;
+    }
+    for (size_t v = 0; v < n; v += 1) {
+        if (skip != NULL && skip[v]) {
+            continue;
+        }
+        const size_t b = fill[block_of[v]];
+        state->ids[state->blocks[b].start + sizes[b].count] = v;
+        sizes[b].count += 1;
+    }
+    state->n = start;
+}
+
+// Maximal paths of verticies which have exactly two neighbors left after
+// pruning, found in the scratch arena. The inner verticies of chain `c` are
+// `inner[first[c]..first[c] + count[c]]`, ordered from `start[c]` to `end[c]`.
+typedef struct {
+    size_t n_chains;
+    size_t *start;
+    size_t *end;
+    size_t *first;
+    size_t *count;
+    size_t *inner;
+    // Sum of the lengths of the edges along the chain
+    float *length;
+} gr_ChainList;
+
+// Paths closing a cycle (both ends are the same vertex) stay untouched.
+static gr_ChainList gr_find_chains(gr_RenderContext *ctx, const gr_Adjacency *adj,
+                                   const bool *pruned, bool *is_inner)
+{
+    const size_t n = ctx->graph->n_verticies;
+    size_t *degree = gr_arena_alloc(ctx, n * sizeof(size_t));
+    bool *visited = gr_arena_alloc(ctx, n * sizeof(bool));
+    gr_ChainList list = {
+        .start = gr_arena_alloc(ctx, n * sizeof(size_t)),
+        .end = gr_arena_alloc(ctx, n * sizeof(size_t)),
+        .first = gr_arena_alloc(ctx, n * sizeof(size_t)),
+        .count = gr_arena_alloc(ctx, n * sizeof(size_t)),
+        .inner = gr_arena_alloc(ctx, n * sizeof(size_t)),
+        .length = gr_arena_alloc(ctx, n * sizeof(float)),
+    };
+    memset(visited, 0, n * sizeof(bool));
+
+    for (size_t v = 0; v < n; v += 1) {
+        degree[v] = 0;
+        for (size_t e = adj->offsets[v]; e < adj->offsets[v + 1]; e += 1) {
+            degree[v] += pruned == NULL || !pruned[adj->neighbors[e]];
+        }
+        if (gr_is_pinned(ctx->pinned, v)) {
+            // pinned verticies can only end a chain
+            degree[v] = SIZE_MAX;
+        }
+    }
+
+    size_t n_inner = 0;
+    for (size_t v = 0; v < n; v += 1) {
+        if ((pruned != NULL && pruned[v]) || degree[v] == 2) {
+            continue;
+        }
+        for (size_t e = adj->offsets[v]; e < adj->offsets[v + 1]; e += 1) {
+            const size_t w = adj->neighbors[e];
+            if ((pruned != NULL && pruned[w]) || degree[w] != 2 || visited[w]) {
+                continue;
+            }
+            const size_t first = n_inner;
+            size_t prev = v;
+            size_t cur = w;
+            float length = adj->lengths == NULL ? 1 : adj->lengths[e];
+            while (degree[cur] == 2 && !visited[cur]) {
+                visited[cur] = true;
+                list.inner[n_inner++] = cur;
+                size_t next = SIZE_MAX;
+                for (size_t f = adj->offsets[cur]; f < adj->offsets[cur + 1]; f += 1) {
+                    const size_t u = adj->neighbors[f];
+                    if (u != prev && (pruned == NULL || !pruned[u])) {
+                        next = u;
+                        length += adj->lengths == NULL ? 1 : adj->lengths[f];
+                        break;
+                    }
+                }
+                assert(next != SIZE_MAX);
+                prev = cur;
+                cur = next;
+            }
+            if (cur == v) {
+                // a cycle through `v` only, there is no edge to contract it to
+                n_inner = first;
+                continue;
+            }
+            list.start[list.n_chains] = v;
+            list.end[list.n_chains] = cur;
+            list.first[list.n_chains] = first;
+            list.count[list.n_chains] = n_inner - first;
+            list.length[list.n_chains] = length;
+            list.n_chains += 1;
+            for (size_t i = first; i < n_inner; i += 1) {
+                is_inner[list.inner[i]] = true;
+            }
+        }
+    }
+    return list;
+}
+
+// Gives the inner verticies of all chains the slots from `next_slot` on.
+// Returns the first slot after them.
+static size_t gr_render_state_chains(gr_RenderContext *ctx, const gr_ChainList *list,
+                                     size_t *slot_of, size_t *block_of,
+                                     size_t next_slot)
+{
+    struct gr_RenderState *state = ctx->state;
+    state->n_chains = list->n_chains;
+    state->chains = gr_ctx_calloc_or_die(ctx, list->n_chains, sizeof(gr_Chain));
+
+    for (size_t c = 0; c < list->n_chains; c += 1) {
+        gr_Chain *chain = &state->chains[c];
+        *chain = (gr_Chain) {
+            .a = slot_of[list->start[c]],
+            .b = slot_of[list->end[c]],
+            .first = next_slot,
+            .count = list->count[c],
+            .block = block_of[list->start[c]],
+            .length = list->length[c],
+        };
+        for (size_t i = 0; i < chain->count; i += 1) {
+            const size_t v = list->inner[list->first[c] + i];
+            state->ids[next_slot] = v;
+            slot_of[v] = next_slot;
+            block_of[v] = chain->block;
+            next_slot += 1;
+        }
+    }
+    return next_slot;
+}
+
+// Edges leaving a laid out vertex with a length other than 1 replace the
+// attraction of the all pairs loop. Chains are attached to the loop, unless
+// their ends are not adjacent, then the first one takes back the repulsion.
+static void gr_render_state_springs(gr_RenderContext *ctx, const gr_Adjacency *adj,
+                                    const size_t *slot_of)
+{
+    struct gr_RenderState *state = ctx->state;
+    bool **edges = ctx->graph->edges;
+    const size_t n = state->n;
+    size_t *offsets = gr_arena_alloc(ctx, (n + 1) * sizeof(size_t));
+    memset(offsets, 0, (n + 1) * sizeof(size_t));
+
+    for (size_t s = 0; s < n && adj->lengths != NULL; s += 1) {
+        const size_t v = state->ids[s];
+        for (size_t e = adj->offsets[v]; e < adj->offsets[v + 1]; e += 1) {
+            const size_t u = adj->neighbors[e];
+            offsets[s + 1] += adj->lengths[e] != 1 && edges[v][u] && slot_of[u] < n;
+        }
+    }
+    for (size_t c = 0; c < state->n_chains; c += 1) {
+        offsets[state->chains[c].a + 1] += 1;
+        offsets[state->chains[c].b + 1] += 1;
+    }
+    for (size_t s = 0; s < n; s += 1) {
+        offsets[s + 1] += offsets[s];
+    }
+    const size_t n_springs = offsets[n];
+    if (n_springs == 0) {
+        return;
+    }
+
+    state->spring_offsets = gr_ctx_calloc_or_die(ctx, n + 1, sizeof(size_t));
+    state->springs = gr_ctx_calloc_or_die(ctx, n_springs, sizeof(gr_Index));
+    state->spring_lengths = gr_ctx_calloc_or_die(ctx, n_springs, sizeof(float));
+    state->spring_cancels = gr_ctx_calloc_or_die(ctx, n_springs, sizeof(bool));
+    memcpy(state->spring_offsets, offsets, (n + 1) * sizeof(size_t));
+
+    // `offsets` is the fill position of every list from here on
+    for (size_t s = 0; s < n && adj->lengths != NULL; s += 1) {
+        const size_t v = state->ids[s];
+        for (size_t e = adj->offsets[v]; e < adj->offsets[v + 1]; e += 1) {
+            const size_t u = adj->neighbors[e];
+            if (adj->lengths[e] != 1 && edges[v][u] && slot_of[u] < n) {
+                state->springs[offsets[s]] = slot_of[u];
+                state->spring_lengths[offsets[s]] = adj->lengths[e];
+                state->spring_cancels[offsets[s]] = true;
+                offsets[s] += 1;
+            }
+        }
+    }
+    for (size_t c = 0; c < state->n_chains; c += 1) {
+        const gr_Chain *chain = &state->chains[c];
+        for (size_t end = 0; end < 2; end += 1) {
+            const size_t s = end == 0 ? chain->a : chain->b;
+            const size_t other = end == 0 ? chain->b : chain->a;
+            bool cancels = !edges[state->ids[s]][state->ids[other]];
+            // parallel chains
+            for (size_t e = state->spring_offsets[s]; e < offsets[s] && cancels; e += 1) {
+                cancels = state->springs[e] != other;
+            }
+            state->springs[offsets[s]] = other;
+            state->spring_lengths[offsets[s]] = chain->length;
+            state->spring_cancels[offsets[s]] = cancels;
+            offsets[s] += 1;
+        }
+    }
+}
+
+// Slot adjacency between the laid out verticies, used to wake up frozen
+// verticies. All of them start out active.
+static void gr_render_state_neighbors(gr_RenderContext *ctx, const gr_Adjacency *adj,
+                                      const size_t *slot_of)
+{
+    struct gr_RenderState *state = ctx->state;
+    const size_t n = state->n;
+    state->calm = gr_ctx_calloc_or_die(ctx, n, sizeof(size_t));
+    state->neighbor_offsets = gr_ctx_calloc_or_die(ctx, n + 1, sizeof(size_t));
+    size_t count = 0;
+    for (size_t s = 0; s < n; s += 1) {
+        const size_t v = state->ids[s];
+        for (size_t e = adj->offsets[v]; e < adj->offsets[v + 1]; e += 1) {
+            count += slot_of[adj->neighbors[e]] < n;
+        }
+    }
+    state->neighbors = gr_ctx_calloc_or_die(ctx, count + 1, sizeof(gr_Index));
+    count = 0;
+    for (size_t s = 0; s < n; s += 1) {
+        const size_t v = state->ids[s];
+        state->neighbor_offsets[s] = count;
+        for (size_t e = adj->offsets[v]; e < adj->offsets[v + 1]; e += 1) {
+            const size_t slot = slot_of[adj->neighbors[e]];
+            if (slot < n) {
+                state->neighbors[count++] = slot;
+            }
+        }
+    }
+    state->neighbor_offsets[n] = count;
+}
+
+// Outgoing edges between the laid out verticies, in the direction the all
+// pairs loop of the kernels attracts along them
+static void gr_render_state_edges(gr_RenderContext *ctx, const gr_Adjacency *adj,
+                                  const size_t *slot_of)
+{
+    struct gr_RenderState *state = ctx->state;
+    bool **edges = ctx->graph->edges;
+    const size_t n = state->n;
+    state->edge_offsets = gr_ctx_calloc_or_die(ctx, n + 1, sizeof(size_t));
+    size_t count = 0;
+    for (size_t s = 0; s < n; s += 1) {
+        const size_t v = state->ids[s];
+        for (size_t e = adj->offsets[v]; e < adj->offsets[v + 1]; e += 1) {
+            const size_t u = adj->neighbors[e];
+            count += edges[v][u] && slot_of[u] < n;
+        }
+    }
+    state->edge_targets = gr_ctx_calloc_or_die(ctx, count + 1, sizeof(gr_Index));
+    count = 0;
+    for (size_t s = 0; s < n; s += 1) {
+        const size_t v = state->ids[s];
+        state->edge_offsets[s] = count;
+        for (size_t e = adj->offsets[v]; e < adj->offsets[v + 1]; e += 1) {
+            const size_t u = adj->neighbors[e];
+            if (edges[v][u] && slot_of[u] < n) {
+                state->edge_targets[count++] = slot_of[u];
+            }
+        }
+    }
+    state->edge_offsets[n] = count;
+}
+
+// Classes of at least two laid out verticies with the same (non empty) set of
+// laid out neighbors, found in the scratch arena. The first member of every
+// class is its representative, the members of class `c` are
+// `members[first[c]..first[c] + count[c]]`.
+typedef struct {
+    size_t n_classes;
+    size_t *first;
+    size_t *count;
+    size_t *members;
+} gr_TwinList;
+
+static uint64_t gr_fnv1a(uint64_t hash, const void *data, const size_t size)
+{
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < size; i += 1) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Hash of the laid out neighbors (which are sorted in the adjacency) and the
+// lengths of the edges to them
+static uint64_t gr_neighborhood_hash(const gr_Adjacency *adj, const bool *skip,
+                                     const size_t v)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t e = adj->offsets[v]; e < adj->offsets[v + 1]; e += 1) {
+        const size_t u = adj->neighbors[e];
+        if (skip[u]) {
+            continue;
+        }
+        hash = gr_fnv1a(hash, &u, sizeof(u));
+        if (adj->lengths != NULL) {
+            hash = gr_fnv1a(hash, &adj->lengths[e], sizeof(adj->lengths[e]));
+        }
+    }
+    return hash;
+}
+
+static bool gr_same_neighborhood(const gr_Adjacency *adj, const bool *skip,
+                                 const size_t a, const size_t b)
+{
+    size_t e = adj->offsets[a];
+    size_t f = adj->offsets[b];
+    for (;;) {
+        while (e < adj->offsets[a + 1] && skip[adj->neighbors[e]]) {
+            e += 1;
+        }
+        while (f < adj->offsets[b + 1] && skip[adj->neighbors[f]]) {
+            f += 1;
+        }
+        const bool a_done = e == adj->offsets[a + 1];
+        const bool b_done = f == adj->offsets[b + 1];
+        if (a_done || b_done) {
+            return a_done && b_done;
+        }
+        if (adj->neighbors[e] != adj->neighbors[f] ||
+            (adj->lengths != NULL && adj->lengths[e] != adj->lengths[f])) {
+            return false;
+        }
+        e += 1;
+        f += 1;
+    }
+}
+
+// Groups the laid out verticies (all without `skip`) by their neighbors with
+// a hash table, so this takes expected linear time in the size of the graph.
+// Verticies with pruned neighbors only are left alone, as well as the ends of
+// contracted chains (skipped but not pruned neighbors), since their springs
+// cannot be shared. All members but the representative get `skip` set.
+static gr_TwinList gr_find_twins(gr_RenderContext *ctx, const gr_Adjacency *adj,
+                                 bool *skip, const bool *pruned)
+{
+    const size_t n = ctx->graph->n_verticies;
+    size_t capacity = 16;
+    while (capacity < 2 * n) {
+        capacity *= 2;
+    }
+    size_t *table = gr_arena_alloc(ctx, capacity * sizeof(size_t));
+    uint64_t *hashes = gr_arena_alloc(ctx, n * sizeof(uint64_t));
+    size_t *reps = gr_arena_alloc(ctx, n * sizeof(size_t));
+    size_t *sizes = gr_arena_alloc(ctx, n * sizeof(size_t));
+    size_t *class_of = gr_arena_alloc(ctx, n * sizeof(size_t));
+    for (size_t i = 0; i < capacity; i += 1) {
+        table[i] = SIZE_MAX;
+    }
+
+    size_t n_classes = 0;
+    for (size_t v = 0; v < n; v += 1) {
+        class_of[v] = SIZE_MAX;
+        if (skip[v] || gr_is_pinned(ctx->pinned, v)) {
+            continue;
+        }
+        bool eligible = false;
+        for (size_t e = adj->offsets[v]; e < adj->offsets[v + 1]; e += 1) {
+            const size_t u = adj->neighbors[e];
+            if (skip[u] && (pruned == NULL || !pruned[u])) {
+                eligible = false;
+                break;
+            }
+            eligible |= !skip[u];
+        }
+        if (!eligible) {
+            continue;
+        }
+        const uint64_t hash = gr_neighborhood_hash(adj, skip, v);
+        size_t slot = hash & (capacity - 1);
+        while (table[slot] != SIZE_MAX) {
+            const size_t c = table[slot];
+            if (hashes[c] == hash && gr_same_neighborhood(adj, skip, reps[c], v)) {
+                break;
+            }
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (table[slot] == SIZE_MAX) {
+            table[slot] = n_classes;
+            hashes[n_classes] = hash;
+            reps[n_classes] = v;
+            sizes[n_classes] = 0;
+            n_classes += 1;
+        }
+        class_of[v] = table[slot];
+        sizes[table[slot]] += 1;
+    }
+
+    // only classes with twins are kept, `reps` now maps to their index
+    gr_TwinList list = {
+        .first = gr_arena_alloc(ctx, n_classes * sizeof(size_t) + 1),
+        .count = gr_arena_alloc(ctx, n_classes * sizeof(size_t) + 1),
+        .members = gr_arena_alloc(ctx, n * sizeof(size_t)),
+    };
+    size_t n_members = 0;
+    for (size_t c = 0; c < n_classes; c += 1) {
+        if (sizes[c] < 2) {
+            reps[c] = SIZE_MAX;
+            continue;
+        }
+        list.first[list.n_classes] = n_members;
+        list.count[list.n_classes] = 0;
+        reps[c] = list.n_classes;
+        n_members += sizes[c];
+        list.n_classes += 1;
+    }
+    for (size_t v = 0; v < n; v += 1) {
+        if (class_of[v] == SIZE_MAX || reps[class_of[v]] == SIZE_MAX) {
+            continue;
+        }
+        const size_t c = reps[class_of[v]];
+        // the smallest vertex of the class comes first and stays laid out
+        skip[v] = list.count[c] > 0;
+        list.members[list.first[c] + list.count[c]] = v;
+        list.count[c] += 1;
+    }
+    return list;
+}
+
+// Gives the twins the slots from `next_slot` on and weights the
+// representatives by the size of their class. Returns the first slot after
+// the twins.
+static size_t gr_render_state_twins(gr_RenderContext *ctx, const gr_TwinList *list,
+                                    size_t *slot_of, size_t *block_of,
+                                    size_t next_slot)
+{
+    struct gr_RenderState *state = ctx->state;
+    state->n_twin_classes = list->n_classes;
+    state->twin_classes = gr_ctx_calloc_or_die(ctx, list->n_classes, sizeof(gr_TwinClass));
+    state->mass = gr_ctx_calloc_or_die(ctx, state->n, sizeof(float));
+    for (size_t s = 0; s < state->n; s += 1) {
+        state->mass[s] = 1;
+    }
+    for (size_t c = 0; c < list->n_classes; c += 1) {
+        const size_t *members = &list->members[list->first[c]];
+        gr_TwinClass *twins = &state->twin_classes[c];
+        *twins = (gr_TwinClass) {
+            .rep = slot_of[members[0]],
+            .first = next_slot,
+            .count = list->count[c] - 1,
+            .block = block_of[members[0]],
+        };
+        state->mass[twins->rep] = list->count[c];
+        for (size_t i = 1; i < list->count[c]; i += 1) {
+            state->ids[next_slot] = members[i];
+            slot_of[members[i]] = next_slot;
+            block_of[members[i]] = twins->block;
+            next_slot += 1;
+        }
+    }
+    return next_slot;
+}
+
+// Assigns the slots from `next_slot` on to the pruned verticies in breadth
+// first order starting at the verticies in the slots before, so parents are
+// always placed before their children.
+static void gr_render_state_leaf_groups(gr_RenderContext *ctx, const gr_Adjacency *adj,
+                                        const bool *pruned, const size_t *parent,
+                                        size_t *slot_of, size_t *block_of,
+                                        size_t next_slot)
+{
+    struct gr_RenderState *state = ctx->state;
+    const size_t n = ctx->graph->n_verticies;
+
+    // children of every vertex, in compressed sparse row format
+    size_t *child_offsets = gr_arena_alloc(ctx, (n + 1) * sizeof(size_t));
+    size_t *children = gr_arena_alloc(ctx, n * sizeof(size_t));
+    memset(child_offsets, 0, (n + 1) * sizeof(size_t));
+    for (size_t v = 0; v < n; v += 1) {
+        if (pruned[v]) {
+            child_offsets[parent[v] + 1] += 1;
+        }
+    }
+    size_t n_groups = 0;
+    for (size_t v = 0; v < n; v += 1) {
+        n_groups += child_offsets[v + 1] > 0;
+        child_offsets[v + 1] += child_offsets[v];
+    }
+    size_t *fill = gr_arena_alloc(ctx, n * sizeof(size_t));
+    memcpy(fill, child_offsets, n * sizeof(size_t));
+    for (size_t v = 0; v < n; v += 1) {
+        if (pruned[v]) {
+            children[fill[parent[v]]++] = v;
+        }
+    }
+
+    state->n_leaf_groups = n_groups;
+    state->leaf_groups = gr_ctx_calloc_or_die(ctx, n_groups, sizeof(gr_LeafGroup));
+    state->leaf_refs = gr_ctx_calloc_or_die(ctx, n_groups * GR_LEAF_REFS, sizeof(gr_Index));
+
+    size_t n_refs = 0;
+    n_groups = 0;
+    // the slots double as the queue of the breadth first search
+    for (size_t s = 0; s < next_slot; s += 1) {
+        const size_t v = state->ids[s];
+        const size_t first_child = child_offsets[v];
+        const size_t n_children = child_offsets[v + 1] - first_child;
+        if (n_children == 0) {
+            continue;
+        }
+        gr_LeafGroup *group = &state->leaf_groups[n_groups++];
+        *group = (gr_LeafGroup) {
+            .parent = s,
+            .first = next_slot,
+            .count = n_children,
+            .block = block_of[v],
+            .ref_first = n_refs,
+            .parent_pruned = pruned[v],
+        };
+        if (pruned[v]) {
+            state->leaf_refs[n_refs++] = slot_of[parent[v]];
+        } else {
+            for (size_t e = adj->offsets[v]; e < adj->offsets[v + 1]; e += 1) {
+                const size_t u = adj->neighbors[e];
+                if (pruned[u]) {
+                    continue;
+                }
+                group->parent_degree += 1;
+                if (n_refs - group->ref_first < GR_LEAF_REFS) {
+                    state->leaf_refs[n_refs++] = slot_of[u];
+                }
+            }
+        }
+        group->ref_count = n_refs - group->ref_first;
+
+        for (size_t c = 0; c < n_children; c += 1) {
+            const size_t child = children[first_child + c];
+            state->ids[next_slot] = child;
+            slot_of[child] = next_slot;
+            block_of[child] = block_of[v];
+            next_slot += 1;
+        }
+    }
+    assert(next_slot == n);
+}
+
+// Undirected graph between the laid out verticies, made of their edges and
+// the contracted chains, in compressed sparse row format
+typedef struct {
+    size_t *offsets;
+    gr_Index *targets;
+    // `NULL` if all edges have length 1
+    float *lengths;
+} gr_SlotGraph;
+
+static gr_SlotGraph gr_slot_graph(gr_RenderContext *ctx, const gr_Adjacency *adj,
+                                  const size_t *slot_of)
+{
+    const struct gr_RenderState *state = ctx->state;
+    const size_t n = state->n;
+    gr_SlotGraph g = {
+        .offsets = gr_arena_alloc(ctx, (n + 1) * sizeof(size_t)),
+    };
+    memset(g.offsets, 0, (n + 1) * sizeof(size_t));
+    for (size_t s = 0; s < n; s += 1) {
+        const size_t v = state->ids[s];
+        for (size_t e = adj->offsets[v]; e < adj->offsets[v + 1]; e += 1) {
+            g.offsets[s + 1] += slot_of[adj->neighbors[e]] < n;
+        }
+    }
+    for (size_t c = 0; c < state->n_chains; c += 1) {
+        g.offsets[state->chains[c].a + 1] += 1;
+        g.offsets[state->chains[c].b + 1] += 1;
+    }
+    for (size_t s = 0; s < n; s += 1) {
+        g.offsets[s + 1] += g.offsets[s];
+    }
+    g.targets = gr_arena_alloc(ctx, g.offsets[n] * sizeof(gr_Index) + 1);
+    if (adj->lengths != NULL || state->n_chains > 0) {
+        g.lengths = gr_arena_alloc(ctx, g.offsets[n] * sizeof(float) + 1);
+    }
+
+    size_t *fill = gr_arena_alloc(ctx, n * sizeof(size_t) + 1);
+    memcpy(fill, g.offsets, n * sizeof(size_t));
+    for (size_t s = 0; s < n; s += 1) {
+        const size_t v = state->ids[s];
+        for (size_t e = adj->offsets[v]; e < adj->offsets[v + 1]; e += 1) {
+            const size_t t = slot_of[adj->neighbors[e]];
+            if (t < n) {
+                if (g.lengths != NULL) {
+                    g.lengths[fill[s]] = adj->lengths == NULL ? 1 : adj->lengths[e];
+                }
+                g.targets[fill[s]++] = t;
+            }
+        }
+    }
+    for (size_t c = 0; c < state->n_chains; c += 1) {
+        const gr_Chain *chain = &state->chains[c];
+        g.lengths[fill[chain->a]] = chain->length;
+        g.targets[fill[chain->a]++] = chain->b;
+        g.lengths[fill[chain->b]] = chain->length;
+        g.targets[fill[chain->b]++] = chain->a;
+    }
+    return g;
+}
+
+typedef struct {
+    float d;
+    size_t slot;
+} gr_HeapItem;
+
+// Shortest distances from `source` to the verticies of its block, the ones
+// which are not reachable stay at `FLT_MAX`. A breadth first search if all
+// edges have length 1, Dijkstra's algorithm otherwise. `queue` must have room
+// for every edge of the block and one more.
+static void gr_slot_distances(const gr_SlotGraph *g, const gr_Block *block,
+                              const size_t source, float *dist, gr_HeapItem *queue)
+{
+    for (size_t s = block->start; s < block->start + block->count; s += 1) {
+        dist[s] = FLT_MAX;
+    }
+    dist[source] = 0;
+    queue[0] = (gr_HeapItem) { .d = 0, .slot = source };
+    if (g->lengths == NULL) {
+        size_t head = 0;
+        size_t tail = 1;
+        while (head < tail) {
+            const size_t s = queue[head++].slot;
+            for (size_t e = g->offsets[s]; e < g->offsets[s + 1]; e += 1) {
+                const size_t t = g->targets[e];
+                if (dist[t] == FLT_MAX) {
+                    dist[t] = dist[s] + 1;
+                    queue[tail++].slot = t;
+                }
+            }
+        }
+        return;
+    }
+
+    size_t size = 1;
+    while (size > 0) {
+        const gr_HeapItem top = queue[0];
+        queue[0] = queue[--size];
+        for (size_t i = 0; 2 * i + 1 < size;) {
+            size_t c = 2 * i + 1;
+            if (c + 1 < size && queue[c + 1].d < queue[c].d) {
+                c += 1;
+            }
+            if (queue[i].d <= queue[c].d) {
+                break;
+            }
+            const gr_HeapItem tmp = queue[i];
+            queue[i] = queue[c];
+            queue[c] = tmp;
+            i = c;
+        }
+        if (top.d > dist[top.slot]) {
+            // outdated entry
+            continue;
+        }
+        for (size_t e = g->offsets[top.slot]; e < g->offsets[top.slot + 1]; e += 1) {
+            const size_t t = g->targets[e];
+            const float d = top.d + g->lengths[e];
+            if (d >= dist[t]) {
+                continue;
+            }
+            dist[t] = d;
+            size_t i = size++;
+            queue[i] = (gr_HeapItem) { .d = d, .slot = t };
+            while (i > 0 && queue[(i - 1) / 2].d > queue[i].d) {
+                const gr_HeapItem tmp = queue[i];
+                queue[i] = queue[(i - 1) / 2];
+                queue[(i - 1) / 2] = tmp;
+                i = (i - 1) / 2;
+            }
+        }
+    }
+}
+
+static int gr_float_cmp(const void *a, const void *b)
+{
+    const float x = *(const float *)a;
+    const float y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+// Appends the term between the slots `i` and `j` unless neither can move
+static void gr_add_stress_term(struct gr_RenderState *state, const size_t i,
+                               const size_t j, const float d, float w_i, float w_j)
+{
+    if (gr_is_pinned(state->pinned, state->ids[i])) {
+        w_i = 0;
+    }
+    if (gr_is_pinned(state->pinned, state->ids[j])) {
+        w_j = 0;
+    }
+    if (w_i == 0 && w_j == 0) {
+        return;
+    }
+    state->terms[state->n_terms++] = (gr_StressTerm) {
+        .i = i,
+        .j = j,
+        .d = d,
+        .w_i = w_i,
+        .w_j = w_j,
+    };
+}
+
+// Stress terms of one block, all pairs if it is small enough, otherwise the
+// sparse approximation of Ortmann, Klimenta and Brandes: pairs connected by an
+// edge, plus every vertex against each pivot, weighted by the number of
+// verticies the pivot stands for at that distance.
+static void gr_render_state_block_stress(gr_RenderContext *ctx, const gr_SlotGraph *g,
+                                         const gr_Block *block, const size_t pivots,
+                                         float *dist, gr_HeapItem *queue)
+{
+    struct gr_RenderState *state = ctx->state;
+    const float *mass = state->mass;
+    const size_t end = block->start + block->count;
+    const size_t first_term = state->n_terms;
+    float d_max = 0;
+
+    if (pivots == 0) {
+        for (size_t i = block->start; i < end; i += 1) {
+            gr_slot_distances(g, block, i, dist, queue);
+            for (size_t j = i + 1; j < end; j += 1) {
+                const float w = dist[j] == FLT_MAX ? 1 : 1 / gr_sq(dist[j]);
+                gr_add_stress_term(state, i, j, dist[j],
+                                   w * (mass == NULL ? 1 : mass[j]),
+                                   w * (mass == NULL ? 1 : mass[i]));
+            }
+        }
+    } else {
+        // distance to the closest pivot and its index, which picks the next
+        // pivot as the vertex farthest from all previous ones
+        float *closest = gr_arena_alloc(ctx, block->count * sizeof(float));
+        size_t *region = gr_arena_alloc(ctx, block->count * sizeof(size_t));
+        size_t *pivot_slots = gr_arena_alloc(ctx, pivots * sizeof(size_t));
+        for (size_t i = 0; i < block->count; i += 1) {
+            closest[i] = FLT_MAX;
+        }
+        size_t next = block->start;
+        for (size_t p = 0; p < pivots; p += 1) {
+            pivot_slots[p] = next;
+            gr_slot_distances(g, block, next, dist, queue);
+            float farthest = -1;
+            for (size_t i = block->start; i < end; i += 1) {
+                if (dist[i] < closest[i - block->start]) {
+                    closest[i - block->start] = dist[i];
+                    region[i - block->start] = p;
+                }
+                if (closest[i - block->start] > farthest) {
+                    farthest = closest[i - block->start];
+                    next = i;
+                }
+                if (i != pivot_slots[p]) {
+                    gr_add_stress_term(state, i, pivot_slots[p], dist[i], 1, 0);
+                }
+            }
+        }
+
+        // sorted distances of the verticies in the region of every pivot
+        size_t *region_offsets = gr_arena_alloc(ctx, (pivots + 1) * sizeof(size_t));
+        float *region_dists = gr_arena_alloc(ctx, block->count * sizeof(float));
+        memset(region_offsets, 0, (pivots + 1) * sizeof(size_t));
+        for (size_t i = 0; i < block->count; i += 1) {
+            region_offsets[region[i] + 1] += 1;
+        }
+        for (size_t p = 0; p < pivots; p += 1) {
+            region_offsets[p + 1] += region_offsets[p];
+        }
+        size_t *fill = gr_arena_alloc(ctx, pivots * sizeof(size_t));
+        memcpy(fill, region_offsets, pivots * sizeof(size_t));
+        for (size_t i = 0; i < block->count; i += 1) {
+            region_dists[fill[region[i]]++] = closest[i];
+        }
+        for (size_t p = 0; p < pivots; p += 1) {
+            qsort(&region_dists[region_offsets[p]], region_offsets[p + 1] - region_offsets[p],
+                  sizeof(float), gr_float_cmp);
+        }
+
+        // terms were added pivot by pivot
+        for (size_t t = first_term; t < state->n_terms; t += 1) {
+            gr_StressTerm *term = &state->terms[t];
+            size_t p = 0;
+            while (pivot_slots[p] != term->j) {
+                p += 1;
+            }
+            const float *lo = &region_dists[region_offsets[p]];
+            size_t count = region_offsets[p + 1] - region_offsets[p];
+            // number of region members at most half as far from the pivot
+            size_t s = 0;
+            while (count > 0) {
+                const size_t half = count / 2;
+                if (lo[s + half] <= term->d / 2) {
+                    s += half + 1;
+                    count -= half + 1;
+                } else {
+                    count = half;
+                }
+            }
+            term->w_i = (s == 0 ? 1 : s) / (term->d == FLT_MAX ? 1 : gr_sq(term->d));
+        }
+
+        for (size_t i = block->start; i < end; i += 1) {
+            for (size_t e = g->offsets[i]; e < g->offsets[i + 1]; e += 1) {
+                const size_t j = g->targets[e];
+                if (j > i) {
+                    const float d = g->lengths == NULL ? 1 : g->lengths[e];
+                    gr_add_stress_term(state, i, j, d,
+                                       (mass == NULL ? 1 : mass[j]) / gr_sq(d),
+                                       (mass == NULL ? 1 : mass[i]) / gr_sq(d));
+                }
+            }
+        }
+    }
+
+    // verticies in different components are kept a bit further apart than
+    // the farthest connected ones
+    for (size_t t = first_term; t < state->n_terms; t += 1) {
+        if (state->terms[t].d != FLT_MAX && state->terms[t].d > d_max) {
+            d_max = state->terms[t].d;
+        }
+    }
+    for (size_t t = first_term; t < state->n_terms; t += 1) {
+        gr_StressTerm *term = &state->terms[t];
+        if (term->d == FLT_MAX) {
+            term->d = d_max + 1;
+            term->w_i = term->w_i == 0 ? 0 : term->w_i / gr_sq(d_max + 1);
+            term->w_j = term->w_j == 0 ? 0 : term->w_j / gr_sq(d_max + 1);
+        }
+    }
+}
+
+static void gr_render_state_stress(gr_RenderContext *ctx, const gr_Adjacency *adj,
+                                   const size_t *slot_of)
+{
+    struct gr_RenderState *state = ctx->state;
+    const gr_SlotGraph g = gr_slot_graph(ctx, adj, slot_of);
+    const size_t requested = ctx->method.sgd.pivots;
+
+    size_t capacity = 0;
+    size_t largest = 0;
+    for (size_t b = 0; b < state->n_blocks; b += 1) {
+        const size_t count = state->blocks[b].count;
+        if (requested == 0 && count <= GR_SGD_EXACT_LIMIT) {
+            capacity += count * (count - 1) / 2;
+        } else {
+            const size_t pivots = requested == 0 ? GR_SGD_PIVOTS : requested;
+            capacity += count * (pivots < count ? pivots : count);
+        }
+        largest = count > largest ? count : largest;
+    }
+    // edges between two pivots show up twice
+    capacity += g.offsets[state->n];
+    state->terms = gr_ctx_calloc_or_die(ctx, capacity + 1, sizeof(gr_StressTerm));
+
+    float *dist = gr_arena_alloc(ctx, state->n * sizeof(float) + 1);
+    gr_HeapItem *queue = gr_arena_alloc(ctx, (g.offsets[state->n] + largest + 1) * sizeof(gr_HeapItem));
+    for (size_t b = 0; b < state->n_blocks; b += 1) {
+        const size_t count = state->blocks[b].count;
+        size_t pivots = 0;
+        if (requested != 0 || count > GR_SGD_EXACT_LIMIT) {
+            pivots = requested == 0 ? GR_SGD_PIVOTS : requested;
+            pivots = pivots < count ? pivots : count;
+        }
+        gr_render_state_block_stress(ctx, &g, &state->blocks[b], pivots, dist, queue);
+    }
+
+    float w_min = FLT_MAX;
+    float w_max = 0;
+    for (size_t t = 0; t < state->n_terms; t += 1) {
+        const gr_StressTerm *term = &state->terms[t];
+        for (size_t side = 0; side < 2; side += 1) {
+            const float w = side == 0 ? term->w_i : term->w_j;
+            if (w > 0) {
+                w_min = w < w_min ? w : w_min;
+                w_max = w > w_max ? w : w_max;
+            }
+        }
+    }
+    state->eta_max = state->n_terms == 0 ? 0 : 1 / w_min;
+    state->eta_min = state->n_terms == 0 ? 0 : ctx->method.sgd.epsilon / w_max;
+    state->seed = 0x9e3779b97f4a7c15ull;
+}
+
+// Key to sort slots or verticies by, ties are broken by `id`
+typedef struct {
+    uint64_t key;
+    size_t id;
+} gr_OrderKey;
+
+static int gr_order_key_cmp(const void *a, const void *b)
+{
+    const gr_OrderKey *l = a;
+    const gr_OrderKey *r = b;
+    if (l->key != r->key) {
+        return l->key < r->key ? -1 : 1;
+    }
+    return l->id < r->id ? -1 : (l->id > r->id);
+}
+
+// Reverse Cuthill-McKee order of the laid out verticies of every block: a
+// breadth first search from a vertex of least degree which visits the
+// neighbors of least degree first, reversed. Keeps neighbors close together.
+static void gr_order_rcm(gr_RenderContext *ctx, const gr_Adjacency *adj)
+{
+    struct gr_RenderState *state = ctx->state;
+    const size_t n = ctx->graph->n_verticies;
+    size_t *block_of = gr_arena_alloc(ctx, n * sizeof(size_t));
+    size_t *degree = gr_arena_alloc(ctx, n * sizeof(size_t));
+    bool *visited = gr_arena_alloc(ctx, n * sizeof(bool));
+    gr_OrderKey *keys = gr_arena_alloc(ctx, state->n * sizeof(gr_OrderKey) + 1);
+    gr_OrderKey *next = gr_arena_alloc(ctx, state->n * sizeof(gr_OrderKey) + 1);
+    size_t *queue = gr_arena_alloc(ctx, state->n * sizeof(size_t) + 1);
+    memset(visited, 0, n * sizeof(bool));
+    for (size_t v = 0; v < n; v += 1) {
+        block_of[v] = SIZE_MAX;
+    }
+    for (size_t b = 0; b < state->n_blocks; b += 1) {
+        const gr_Block *block = &state->blocks[b];
+        for (size_t s = block->start; s < block->start + block->count; s += 1) {
+            block_of[state->ids[s]] = b;
+        }
+    }
+
+    for (size_t b = 0; b < state->n_blocks; b += 1) {
+        const gr_Block *block = &state->blocks[b];
+        gr_Index *ids = &state->ids[block->start];
+        // degrees within the block, the other verticies are not laid out
+        for (size_t i = 0; i < block->count; i += 1) {
+            const size_t v = ids[i];
+            degree[v] = 0;
+            for (size_t e = adj->offsets[v]; e < adj->offsets[v + 1]; e += 1) {
+                degree[v] += block_of[adj->neighbors[e]] == b;
+            }
+        }
+        // start verticies, least degree first
+        for (size_t i = 0; i < block->count; i += 1) {
+            keys[i] = (gr_OrderKey) { .key = degree[ids[i]], .id = ids[i] };
+        }
+        qsort(keys, block->count, sizeof(*keys), gr_order_key_cmp);
+
+        size_t head = 0;
+        size_t tail = 0;
+        for (size_t i = 0; i < block->count; i += 1) {
+            if (visited[keys[i].id]) {
+                continue;
+            }
+            visited[keys[i].id] = true;
+            queue[tail++] = keys[i].id;
+            while (head < tail) {
+                const size_t u = queue[head++];
+                size_t count = 0;
+                for (size_t e = adj->offsets[u]; e < adj->offsets[u + 1]; e += 1) {
+                    const size_t w = adj->neighbors[e];
+                    if (block_of[w] == b && !visited[w]) {
+                        visited[w] = true;
+                        next[count++] = (gr_OrderKey) { .key = degree[w], .id = w };
+                    }
+                }
+                qsort(next, count, sizeof(*next), gr_order_key_cmp);
+                for (size_t j = 0; j < count; j += 1) {
+                    queue[tail++] = next[j].id;
+                }
+            }
+        }
+        for (size_t i = 0; i < block->count; i += 1) {
+            ids[i] = queue[block->count - 1 - i];
+        }
+    }
+}
+
+#define GR_HILBERT_BITS 16
+
+// Position of the cell `(x, y)` of a `2^GR_HILBERT_BITS` wide grid along the
+// Hilbert curve through it
+static uint64_t gr_hilbert_index(uint32_t x, uint32_t y)
+{
+    const uint32_t side = (uint32_t)1 << GR_HILBERT_BITS;
+    uint64_t d = 0;
+    for (uint32_t s = side / 2; s > 0; s /= 2) {
+        const uint32_t rx = (x & s) > 0;
+        const uint32_t ry = (y & s) > 0;
+        d += (uint64_t)s * s * ((3 * rx) ^ ry);
+        // turn the quadrant, so the curve enters it at the origin
+        if (ry == 0) {
+            if (rx == 1) {
+                x = side - 1 - x;
+                y = side - 1 - y;
+            }
+            const uint32_t t = x;
+            x = y;
+            y = t;
+        }
+    }
+    return d;
+}
+
+// Moves `size` bytes large elements `data[old_of[i]]` to `data[i]`
+static void gr_permute(gr_RenderContext *ctx, void *data, const size_t size,
+                       const size_t count, const size_t *old_of)
+{
+    char *bytes = data;
+    char *copy = gr_arena_alloc(ctx, count * size + 1);
+    memcpy(copy, bytes, count * size);
+    for (size_t i = 0; i < count; i += 1) {
+        memcpy(&bytes[i * size], &copy[old_of[i] * size], size);
+    }
+}
+
+// Moves the list of every laid out slot along with it and renames the slots
+// in them, `lengths` and `flags` are parallel to `entries` or `NULL`
+static void gr_permute_lists(gr_RenderContext *ctx, size_t *offsets, gr_Index *entries,
+                             float *lengths, bool *flags, const size_t *old_of,
+                             const size_t *new_of)
+{
+    const size_t n = ctx->state->n;
+    const size_t total = offsets[n];
+    size_t *old_offsets = gr_arena_alloc(ctx, (n + 1) * sizeof(size_t));
+    gr_Index *old_entries = gr_arena_alloc(ctx, total * sizeof(gr_Index) + 1);
+    float *old_lengths = gr_arena_alloc(ctx, total * sizeof(float) + 1);
+    bool *old_flags = gr_arena_alloc(ctx, total * sizeof(bool) + 1);
+    memcpy(old_offsets, offsets, (n + 1) * sizeof(size_t));
+    memcpy(old_entries, entries, total * sizeof(gr_Index));
+    if (lengths != NULL) {
+        memcpy(old_lengths, lengths, total * sizeof(float));
+    }
+    if (flags != NULL) {
+        memcpy(old_flags, flags, total * sizeof(bool));
+    }
+
+    size_t count = 0;
+    for (size_t s = 0; s < n; s += 1) {
+        const size_t old = old_of[s];
+        offsets[s] = count;
+        for (size_t e = old_offsets[old]; e < old_offsets[old + 1]; e += 1) {
+            const size_t t = old_entries[e];
+            entries[count] = t < n ? new_of[t] : t;
+            if (lengths != NULL) {
+                lengths[count] = old_lengths[e];
+            }
+            if (flags != NULL) {
+                flags[count] = old_flags[e];
+            }
+            count += 1;
+        }
+    }
+    offsets[n] = count;
+}
+
+static size_t gr_permute_slot(const struct gr_RenderState *state, const size_t *new_of,
+                              const size_t s)
+{
+    return s < state->n ? new_of[s] : s;
+}
+
+// Moves the laid out vertex in slot `old_of[s]` into slot `s` along with all
+// it has in the state. Slots never leave their block, the neighbor lists are
+// rebuilt in the next step.
+static void gr_render_state_permute(gr_RenderContext *ctx, const size_t *old_of)
+{
+    struct gr_RenderState *state = ctx->state;
+    const size_t n = state->n;
+    size_t *new_of = gr_arena_alloc(ctx, n * sizeof(size_t) + 1);
+    for (size_t s = 0; s < n; s += 1) {
+        new_of[old_of[s]] = s;
+    }
+
+    gr_permute(ctx, state->ids, sizeof(gr_Index), n, old_of);
+    gr_permute(ctx, state->pos, sizeof(gr_Vec2), n, old_of);
+    if (state->mass != NULL) {
+        gr_permute(ctx, state->mass, sizeof(float), n, old_of);
+    }
+    if (state->degrees != NULL) {
+        gr_permute(ctx, state->degrees, sizeof(float), n, old_of);
+        gr_permute(ctx, state->prev_forces, sizeof(gr_Vec2), n, old_of);
+    }
+    if (state->calm != NULL) {
+        gr_permute(ctx, state->calm, sizeof(size_t), n, old_of);
+        gr_permute_lists(ctx, state->neighbor_offsets, state->neighbors, NULL, NULL,
+                         old_of, new_of);
+    }
+    if (state->spring_offsets != NULL) {
+        gr_permute_lists(ctx, state->spring_offsets, state->springs,
+                         state->spring_lengths, state->spring_cancels, old_of, new_of);
+    }
+    if (state->edge_offsets != NULL) {
+        gr_permute_lists(ctx, state->edge_offsets, state->edge_targets, NULL, NULL,
+                         old_of, new_of);
+    }
+
+    for (size_t c = 0; c < state->n_twin_classes; c += 1) {
+        gr_TwinClass *twins = &state->twin_classes[c];
+        twins->rep = gr_permute_slot(state, new_of, twins->rep);
+    }
+    for (size_t c = 0; c < state->n_chains; c += 1) {
+        gr_Chain *chain = &state->chains[c];
+        chain->a = gr_permute_slot(state, new_of, chain->a);
+        chain->b = gr_permute_slot(state, new_of, chain->b);
+    }
+    for (size_t g = 0; g < state->n_leaf_groups; g += 1) {
+        gr_LeafGroup *group = &state->leaf_groups[g];
+        group->parent = gr_permute_slot(state, new_of, group->parent);
+        for (size_t r = group->ref_first; r < group->ref_first + group->ref_count; r += 1) {
+            state->leaf_refs[r] = gr_permute_slot(state, new_of, state->leaf_refs[r]);
+        }
+    }
+    for (size_t t = 0; t < state->n_terms; t += 1) {
+        gr_StressTerm *term = &state->terms[t];
+        term->i = gr_permute_slot(state, new_of, term->i);
+        term->j = gr_permute_slot(state, new_of, term->j);
+    }
+    for (size_t b = 0; b < state->n_blocks; b += 1) {
+        state->blocks[b].verlet_reach = 0;
+    }
+}
+
+// Sorts the laid out verticies of every block along a Hilbert curve over the
+// square around their current positions
+static void gr_order_hilbert(gr_RenderContext *ctx)
+{
+    struct gr_RenderState *state = ctx->state;
+    const gr_Vec2 *pos = state->pos;
+    gr_OrderKey *keys = gr_arena_alloc(ctx, state->n * sizeof(gr_OrderKey) + 1);
+    size_t *old_of = gr_arena_alloc(ctx, state->n * sizeof(size_t) + 1);
+    const float cells = (float)(((uint32_t)1 << GR_HILBERT_BITS) - 1);
+    for (size_t b = 0; b < state->n_blocks; b += 1) {
+        const gr_Block *block = &state->blocks[b];
+        const size_t end = block->start + block->count;
+        gr_Vec2 min = gr_vec2(FLT_MAX, FLT_MAX);
+        gr_Vec2 max = gr_vec2(-FLT_MAX, -FLT_MAX);
+        for (size_t s = block->start; s < end; s += 1) {
+            gr_bbox_include(&min, &max, pos[s]);
+        }
+        const float side = fmaxf(max.x - min.x, max.y - min.y);
+        // a diverged layout ends up in a single cell
+        const float scale = side > 0 && side < FLT_MAX ? cells / side : 0;
+        for (size_t s = block->start; s < end; s += 1) {
+            const float x = (pos[s].x - min.x) * scale;
+            const float y = (pos[s].y - min.y) * scale;
+            keys[s] = (gr_OrderKey) {
+                .key = gr_hilbert_index(x > 0 ? (x < cells ? (uint32_t)x : (uint32_t)cells) : 0,
+                                        y > 0 ? (y < cells ? (uint32_t)y : (uint32_t)cells) : 0),
+                .id = s,
+            };
+        }
+        qsort(&keys[block->start], block->count, sizeof(*keys), gr_order_key_cmp);
+        for (size_t s = block->start; s < end; s += 1) {
+            old_of[s] = keys[s].id;
+        }
+    }
+    gr_render_state_permute(ctx, old_of);
+}
+
+// (Re)creates the render state if it does not match the graph or the options
+// anymore. Returns `true` if the existing state was reused.
+static bool gr_render_prepare(gr_RenderContext *ctx)
+{
+    struct gr_RenderState *state = ctx->state;
+    const size_t n_threads = ctx->n_threads == 0 ? 1 : ctx->n_threads;
+    if (state != NULL &&
+        state->split_components == ctx->split_components &&
+        state->prune_leaves == ctx->prune_leaves &&
+        state->compress_chains == ctx->compress_chains &&
+        state->collapse_twins == ctx->collapse_twins &&
+        state->freeze == (ctx->freeze_threshold > 0) &&
+        state->sampling == (ctx->repulsion_samples > 0) &&
+        state->verlet == (ctx->verlet_cutoff > 0) &&
+        state->kind == ctx->method.kind &&
+        state->order == ctx->vertex_order &&
+        (state->kind != GR_RM_SGD || state->sgd_pivots == ctx->method.sgd.pivots) &&
+        state->pinned == ctx->pinned &&
+        state->n_threads == n_threads &&
+        state->n_edges == ctx->graph->n_edges &&
+        state->lengths_version == ctx->graph->lengths_version &&
+        state->vertex_pos == ctx->vertex_pos) {
+        return true;
+    }
+    gr_render_state_destroy(ctx);
+
+    const size_t n = ctx->graph->n_verticies;
+    state = ctx->state = gr_ctx_calloc_or_die(ctx, 1, sizeof(*state));
+    state->split_components = ctx->split_components;
+    state->prune_leaves = ctx->prune_leaves;
+    state->compress_chains = ctx->compress_chains;
+    state->collapse_twins = ctx->collapse_twins;
+    state->freeze = ctx->freeze_threshold > 0;
+    state->sampling = ctx->repulsion_samples > 0;
+    state->verlet = ctx->verlet_cutoff > 0;
+    state->kind = ctx->method.kind;
+    state->order = ctx->vertex_order;
+    state->sgd_pivots = state->kind == GR_RM_SGD ? ctx->method.sgd.pivots : 0;
+    state->pinned = ctx->pinned;
+    state->n_threads = n_threads;
+    state->n_edges = ctx->graph->n_edges;
+    state->lengths_version = ctx->graph->lengths_version;
+    state->vertex_pos = ctx->vertex_pos;
+    state->ids = gr_ctx_calloc_or_die(ctx, n, sizeof(gr_Index));
+
+    // verticies which are not laid out themselves
+    bool *skip = gr_arena_alloc(ctx, n * sizeof(bool));
+    memset(skip, 0, n * sizeof(bool));
+    bool *pruned = NULL;
+    size_t *parent = NULL;
+    // the edges of every vertex are needed for the attraction anyway
+    const gr_Adjacency adj = gr_graph_adjacency(ctx);
+    gr_ChainList chains = { 0 };
+    gr_TwinList twins = { 0 };
+    if (ctx->prune_leaves) {
+        pruned = gr_arena_alloc(ctx, n * sizeof(bool));
+        parent = gr_arena_alloc(ctx, n * sizeof(size_t));
+        memset(pruned, 0, n * sizeof(bool));
+        gr_prune_leaves(ctx, &adj, pruned, parent);
+        memcpy(skip, pruned, n * sizeof(bool));
+    }
+    if (ctx->compress_chains) {
+        chains = gr_find_chains(ctx, &adj, pruned, skip);
+    }
+    if (ctx->collapse_twins) {
+        twins = gr_find_twins(ctx, &adj, skip, pruned);
+    }
+
+    gr_render_state_make_blocks(ctx, skip, ctx->split_components);
+    if (state->order == GR_ORDER_RCM) {
+        gr_order_rcm(ctx, &adj);
+    }
+    size_t *slot_of = gr_arena_alloc(ctx, n * sizeof(size_t));
+    size_t *block_of = gr_arena_alloc(ctx, n * sizeof(size_t));
+    for (size_t b = 0; b < state->n_blocks; b += 1) {
+        const gr_Block *block = &state->blocks[b];
+        for (size_t s = block->start; s < block->start + block->count; s += 1) {
+            slot_of[state->ids[s]] = s;
+            block_of[state->ids[s]] = b;
+        }
+    }
+    size_t next_slot = state->n;
+    if (twins.n_classes > 0) {
+        next_slot = gr_render_state_twins(ctx, &twins, slot_of, block_of, next_slot);
+    }
+    if (chains.n_chains > 0) {
+        next_slot = gr_render_state_chains(ctx, &chains, slot_of, block_of, next_slot);
+    }
+    if (pruned != NULL) {
+        gr_render_state_leaf_groups(ctx, &adj, pruned, parent, slot_of,
+                                    block_of, next_slot);
+    }
+    gr_render_state_springs(ctx, &adj, slot_of);
+    if (state->freeze) {
+        gr_render_state_neighbors(ctx, &adj, slot_of);
+    }
+    if (state->kind == GR_RM_SGD) {
+        gr_render_state_stress(ctx, &adj, slot_of);
+    } else {
+        gr_render_state_edges(ctx, &adj, slot_of);
+    }
+#ifdef GR_TILING
+    // a source needs its position, mass, degree and force
+    const size_t source_size = sizeof(gr_Vec2) + 2 * sizeof(float) + sizeof(gr_Vec2);
+    state->tile_cols = gr_cache_size(1, 32 * 1024) / 2 / source_size;
+    state->tile_rows = gr_cache_size(2, 1024 * 1024) / 2 / source_size;
+    state->tile_cols = state->tile_cols < 64 ? 64 : state->tile_cols;
+    state->tile_rows = state->tile_rows < state->tile_cols ? state->tile_cols : state->tile_rows;
+#else
+    state->tile_cols = SIZE_MAX;
+    state->tile_rows = SIZE_MAX;
+#endif // GR_TILING
+    if (state->kind != GR_RM_SGD && state->kind != GR_RM_ForceAtlas2 &&
+        state->n > state->tile_cols) {
+        state->forces = gr_ctx_calloc_or_die(ctx, state->n, sizeof(gr_Vec2));
+    }
+    if (state->kind == GR_RM_ForceAtlas2) {
+        state->degrees = gr_ctx_calloc_or_die(ctx, state->n, sizeof(float));
+        state->forces = gr_ctx_calloc_or_die(ctx, state->n, sizeof(gr_Vec2));
+        state->prev_forces = gr_ctx_calloc_or_die(ctx, state->n, sizeof(gr_Vec2));
+        for (size_t s = 0; s < state->n; s += 1) {
+            const size_t v = state->ids[s];
+            state->degrees[s] = adj.offsets[v + 1] - adj.offsets[v] + 1;
+        }
+        for (size_t b = 0; b < state->n_blocks; b += 1) {
+            state->blocks[b].speed = 1;
+        }
+    }
+
+    if (state->n == n && state->n_blocks == 1 && state->order == GR_ORDER_NONE) {
+        state->pos = ctx->vertex_pos;
+    } else {
+        state->pos = gr_ctx_calloc_or_die(ctx, n, sizeof(gr_Vec2));
+    }
+    if (state->n_blocks > 1) {
+        state->offsets = gr_ctx_calloc_or_die(ctx, state->n_blocks, sizeof(gr_Vec2));
+    }
+    for (size_t b = 0; b < state->n_blocks && state->pinned != NULL; b += 1) {
+        gr_Block *block = &state->blocks[b];
+        for (size_t s = block->start; s < block->start + block->count; s += 1) {
+            block->pinned |= gr_is_pinned(state->pinned, state->ids[s]);
+        }
+    }
+    if (state->verlet) {
+        state->verlet_counts = gr_ctx_calloc_or_die(ctx, state->n, sizeof(size_t));
+        state->verlet_lists = gr_ctx_calloc_or_die(ctx, state->n * GR_VERLET_NEIGHBORS,
+                                                   sizeof(gr_Index));
+        state->verlet_ref = gr_ctx_calloc_or_die(ctx, state->n, sizeof(gr_Vec2));
+        state->cell_heads = gr_ctx_calloc_or_die(ctx, 2 * state->n + state->n_blocks,
+                                                 sizeof(gr_Index));
+        state->cell_next = gr_ctx_calloc_or_die(ctx, state->n, sizeof(gr_Index));
+    }
+    gr_pool_create(ctx, n_threads);
+    if (state->pool != NULL && state->n_blocks > 1) {
+        state->block_order = gr_ctx_calloc_or_die(ctx, state->n_blocks, sizeof(size_t));
+        state->block_work = gr_ctx_calloc_or_die(ctx, state->n_blocks, sizeof(gr_ComponentSize));
+    }
+    if (state->pool != NULL && state->n_blocks == 1 && state->kind == GR_RM_ForceAtlas2) {
+        state->partial_forces = gr_ctx_calloc_or_die(ctx, n_threads * state->n, sizeof(gr_Vec2));
+    }
+    return false;
+}
+
+static gr_Vec2 gr_method_grav_cen(const gr_RenderMethod *method)
+{
+    switch (method->kind) {
+        case GR_RM_Eades:
+            return method->eades.grav_cen;
+        case GR_RM_Fruchterman_and_Reingold:
+            return method->fruchtgold.grav_cen;
+        case GR_RM_SGD:
+            return method->sgd.grav_cen;
+        case GR_RM_ForceAtlas2:
+            return method->force_atlas.grav_cen;
+        default:
+            fprintf(stderr, "Unreachable render method kind: %d\n", method->kind);
+            abort();
+    }
+}
+
+// Length of an ideal edge when laying out `count` verticies
+static float gr_method_edge_length(const gr_RenderMethod *method, const size_t count)
+{
+    switch (method->kind) {
+        case GR_RM_Eades:
+            return method->eades.c2;
+        case GR_RM_Fruchterman_and_Reingold:
+            return method->fruchtgold.c * sqrtf(method->fruchtgold.area / count);
+        case GR_RM_SGD:
+            return method->sgd.length;
+        case GR_RM_ForceAtlas2:
+            // where attraction and repulsion of two leaves cancel out
+            return 2 * sqrtf(method->force_atlas.scaling);
+        default:
+            fprintf(stderr, "Unreachable render method kind: %d\n", method->kind);
+            abort();
+    }
+}
+
+static void gr_block_include(gr_Block *block, const gr_Vec2 p)
+{
+    gr_bbox_include(&block->min, &block->max, p);
+}
+
+static uint64_t gr_xorshift(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+static uint64_t gr_splitmix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// Random generator of the samples of slot `n` in the current step. It only
+// depends on those two, not on the thread the block ends up on.
+static uint64_t gr_sample_seed(const struct gr_RenderState *state, const size_t n)
+{
+    return gr_splitmix64(gr_splitmix64(state->step) + n) | 1;
+}
+
+// Uniformly distributed slot of the block other than `n`
+static size_t gr_sample_other(uint64_t *rng, const gr_Block *block, const size_t n)
+{
+    const size_t i = block->start + gr_xorshift(rng) % (block->count - 1);
+    return i >= n ? i + 1 : i;
+}
+
+// Whether the kernels sample the repulsion of the block instead of going
+// over all pairs, which only pays off with less samples than verticies
+static bool gr_block_sampled(const struct gr_RenderState *state, const gr_Block *block)
+{
+    return state->verlet_counts == NULL && state->samples > 0 &&
+           state->samples + 1 < block->count;
+}
+
+#define GR_VERLET_SKIN 0.3f
+
+// Puts `t` into the neighbor list of `s` if it is not full or `t` is closer
+// than the farthest one, `dists` holds the squared distances of the list
+static void gr_verlet_insert(struct gr_RenderState *state, const size_t s,
+                             const size_t t, const float d_sq, float *dists)
+{
+    gr_Index *list = &state->verlet_lists[s * GR_VERLET_NEIGHBORS];
+    size_t *count = &state->verlet_counts[s];
+    if (*count < GR_VERLET_NEIGHBORS) {
+        dists[*count] = d_sq;
+        list[(*count)++] = t;
+        return;
+    }
+    size_t farthest = 0;
+    for (size_t l = 1; l < GR_VERLET_NEIGHBORS; l += 1) {
+        if (dists[l] > dists[farthest]) {
+            farthest = l;
+        }
+    }
+    if (d_sq < dists[farthest]) {
+        dists[farthest] = d_sq;
+        list[farthest] = t;
+    }
+}
+
+// Whether `t` is in the neighbor list of `s`, so `s` was repelled by it
+static bool gr_verlet_contains(const struct gr_RenderState *state, const size_t s,
+                               const size_t t)
+{
+    const gr_Index *list = &state->verlet_lists[s * GR_VERLET_NEIGHBORS];
+    for (size_t l = 0; l < state->verlet_counts[s]; l += 1) {
+        if (list[l] == t) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Collects the verticies within `reach` of every vertex of the block through
+// a grid of cells about `reach` wide
+static void gr_verlet_build(struct gr_RenderState *state, gr_Block *block,
+                            const float cutoff, const float reach)
+{
+    const gr_Vec2 *pos = state->pos;
+    const size_t b = block - state->blocks;
+    const size_t end = block->start + block->count;
+    gr_Vec2 min = gr_vec2(FLT_MAX, FLT_MAX);
+    gr_Vec2 max = gr_vec2(-FLT_MAX, -FLT_MAX);
+    bool finite = true;
+    for (size_t s = block->start; s < end; s += 1) {
+        gr_bbox_include(&min, &max, pos[s]);
+        finite &= isfinite(pos[s].x) && isfinite(pos[s].y);
+    }
+    if (!finite || !isfinite(max.x - min.x) || !isfinite(max.y - min.y)) {
+        // the layout diverged, nothing to look for
+        for (size_t s = block->start; s < end; s += 1) {
+            state->verlet_counts[s] = 0;
+            state->verlet_ref[s] = pos[s];
+        }
+        block->verlet_reach = reach;
+        block->verlet_slack = FLT_MAX;
+        return;
+    }
+    // at most two cells per vertex
+    float cell = reach;
+    while (((max.x - min.x) / cell + 1) * ((max.y - min.y) / cell + 1) > 2 * block->count + 1) {
+        cell *= 1.5f;
+    }
+    const size_t cols = (size_t)((max.x - min.x) / cell) + 1;
+    const size_t rows = (size_t)((max.y - min.y) / cell) + 1;
+
+    gr_Index *heads = &state->cell_heads[2 * block->start + b];
+    for (size_t c = 0; c < cols * rows; c += 1) {
+        heads[c] = GR_INDEX_MAX;
+    }
+    for (size_t s = block->start; s < end; s += 1) {
+        const size_t c = (size_t)((pos[s].y - min.y) / cell) * cols +
+                         (size_t)((pos[s].x - min.x) / cell);
+        state->cell_next[s] = heads[c];
+        heads[c] = s;
+    }
+
+    const long r = (long)ceilf(reach / cell);
+    float dists[GR_VERLET_NEIGHBORS];
+    // full lists only hold everything up to their farthest vertex
+    float covered = gr_sq(reach);
+    for (size_t s = block->start; s < end; s += 1) {
+        const long cx = (long)((pos[s].x - min.x) / cell);
+        const long cy = (long)((pos[s].y - min.y) / cell);
+        state->verlet_counts[s] = 0;
+        for (long y = cy - r; y <= cy + r; y += 1) {
+            for (long x = cx - r; x <= cx + r; x += 1) {
+                if (x < 0 || y < 0 || x >= (long)cols || y >= (long)rows) {
+                    continue;
+                }
+                for (size_t t = heads[y * cols + x]; t != GR_INDEX_MAX; t = state->cell_next[t]) {
+                    const float d_sq = gr_sq(pos[t].x - pos[s].x) + gr_sq(pos[t].y - pos[s].y);
+                    if (t != s && d_sq <= gr_sq(reach)) {
+                        gr_verlet_insert(state, s, t, d_sq, dists);
+                    }
+                }
+            }
+        }
+        if (state->verlet_counts[s] == GR_VERLET_NEIGHBORS) {
+            float farthest = 0;
+            for (size_t l = 0; l < GR_VERLET_NEIGHBORS; l += 1) {
+                farthest = fmaxf(farthest, dists[l]);
+            }
+            covered = fminf(covered, farthest);
+        }
+        state->verlet_ref[s] = pos[s];
+    }
+    block->verlet_reach = reach;
+    // no pair can get within the cutoff unnoticed while both verticies moved
+    // less than half of the skin, which is thinner if lists are full
+    const float inner = fminf(cutoff, sqrtf(covered) / (1 + GR_VERLET_SKIN));
+    block->verlet_slack = GR_VERLET_SKIN * inner / 2;
+}
+
+// Rebuilds the neighbor lists of the block if they were built for another
+// cutoff or a vertex moved too far since then
+static void gr_verlet_update(struct gr_RenderState *state, gr_Block *block, const float cutoff)
+{
+    const float reach = (1 + GR_VERLET_SKIN) * cutoff;
+    bool rebuild = block->verlet_reach != reach;
+    const float limit = gr_sq(block->verlet_slack);
+    for (size_t s = block->start; s < block->start + block->count && !rebuild; s += 1) {
+        const gr_Vec2 ref = state->verlet_ref[s];
+        rebuild = gr_sq(state->pos[s].x - ref.x) + gr_sq(state->pos[s].y - ref.y) > limit;
+    }
+    if (rebuild) {
+        gr_verlet_build(state, block, cutoff, reach);
+    }
+}
+
+// Counts the steps the vertex in slot `n` stayed below `threshold` and wakes
+// up its neighbors if it moved far
+static void gr_track_activity(struct gr_RenderState *state, const size_t n,
+                              const gr_Vec2 move, const float threshold)
+{
+    size_t *calm = state->calm;
+    const float d = sqrtf(gr_sq(move.x) + gr_sq(move.y));
+    if (d < threshold) {
+        calm[n] += calm[n] < GR_FREEZE_STEPS;
+        return;
+    }
+    calm[n] = 0;
+    if (d > GR_FREEZE_WAKE * threshold) {
+        for (size_t e = state->neighbor_offsets[n]; e < state->neighbor_offsets[n + 1]; e += 1) {
+            calm[state->neighbors[e]] = 0;
+        }
+        if (state->spring_offsets != NULL) {
+            for (size_t e = state->spring_offsets[n]; e < state->spring_offsets[n + 1]; e += 1) {
+                calm[state->springs[e]] = 0;
+            }
+        }
+    }
+}
+
+// Repulsion of a vertex by another one `(d_x, d_y)` away with mass `m`
+GR_TEMPLATE gr_Vec2 gr_pair_eades(const float c3, const float d_x, const float d_y,
+                                  const float m, const bool fast)
+{
+    const float inv_d = gr_frsqrt(gr_sq(d_x) + gr_sq(d_y), fast);
+    const float d   = gr_fdist(gr_sq(d_x) + gr_sq(d_y), inv_d, fast);
+    const float f   = m * gr_fdiv_d_sq(c3, d, inv_d, fast);
+    return gr_vec2(-f * gr_fdiv_d(d_x, d, inv_d, fast), -f * gr_fdiv_d(d_y, d, inv_d, fast));
+}
+
+GR_TEMPLATE gr_Vec2 gr_pair_fruchtgold(const float k, const float d_x, const float d_y,
+                                       const float m, const bool fast)
+{
+    const float inv_d = gr_frsqrt(gr_sq(d_x) + gr_sq(d_y), fast);
+    const float d   = gr_fdist(gr_sq(d_x) + gr_sq(d_y), inv_d, fast);
+    const float f   = m * -gr_fdiv_d(gr_sq(k), d, inv_d, fast);
+    return gr_vec2(f * gr_fdiv_d(d_x, d, inv_d, fast), f * gr_fdiv_d(d_y, d, inv_d, fast));
+}
+
+// Repulsion of `n` by all verticies `[first, last)` added to `force`, `c` is
+// `c3` for Eades and `k` for Fruchterman-Reingold. `n` itself adds nothing as
+// its direction is zero.
+GR_TEMPLATE gr_Vec2 gr_repel_exact(const enum gr_RenderMethodKind kind, const float c,
+                                   const struct gr_RenderState *state, const size_t n,
+                                   const size_t first, const size_t last, gr_Vec2 force,
+                                   const bool weighted, const bool fast)
+{
+    const gr_Vec2 *pos = state->pos;
+    const float *mass = state->mass;
+    size_t i = first;
+    if (fast) {
+        float lane_x[GR_LANES] = { 0 };
+        float lane_y[GR_LANES] = { 0 };
+        for (; i + GR_LANES <= last; i += GR_LANES) {
+            for (size_t l = 0; l < GR_LANES; l += 1) {
+                const float d_x = pos[i + l].x - pos[n].x;
+                const float d_y = pos[i + l].y - pos[n].y;
+                const float m   = weighted ? mass[i + l] : 1;
+                const gr_Vec2 f = kind == GR_RM_Eades ? gr_pair_eades(c, d_x, d_y, m, true)
+                                                      : gr_pair_fruchtgold(c, d_x, d_y, m, true);
+                lane_x[l] += f.x;
+                lane_y[l] += f.y;
+            }
+        }
+        for (size_t l = 0; l < GR_LANES; l += 1) {
+            force.x += lane_x[l];
+            force.y += lane_y[l];
+        }
+    }
+    for (; i < last; i += 1) {
+        const float d_x = pos[i].x - pos[n].x;
+        const float d_y = pos[i].y - pos[n].y;
+        // a collapsed vertex acts like all verticies it stands for
+        const float m   = weighted ? mass[i] : 1;
+        const gr_Vec2 f = kind == GR_RM_Eades ? gr_pair_eades(c, d_x, d_y, m, fast)
+                                              : gr_pair_fruchtgold(c, d_x, d_y, m, fast);
+        force.x += f.x;
+        force.y += f.y;
+    }
+    return force;
+}
+
+// Repulsion of the targets `[first, last)` of the block by all its verticies,
+// one tile of sources after the other, into `state->forces`
+GR_TEMPLATE void gr_tile_eades(const struct gr_RenderMethodEades *eades,
+                               struct gr_RenderState *state, const gr_Block *block,
+                               const size_t first, const size_t last, const bool weighted,
+                               const bool fast)
+{
+    gr_Vec2 *forces = state->forces;
+    const size_t end = block->start + block->count;
+    for (size_t n = first; n < last; n += 1) {
+        forces[n] = gr_vec2zero();
+    }
+    for (size_t s = block->start; s < end; s += state->tile_cols) {
+        const size_t s_end = s + state->tile_cols < end ? s + state->tile_cols : end;
+        for (size_t n = first; n < last; n += 1) {
+            if ((state->calm != NULL && state->calm[n] >= GR_FREEZE_STEPS) ||
+                gr_is_pinned(state->pinned, state->ids[n])) {
+                continue;
+            }
+            forces[n] = gr_repel_exact(GR_RM_Eades, eades->c3, state, n, s, s_end, forces[n],
+                                       weighted, fast);
+        }
+    }
+}
+
+GR_TEMPLATE void gr_step_method_eades(const struct gr_RenderMethodEades *eades,
+                                      const gr_Graph *graph,
+                                      struct gr_RenderState *state,
+                                      gr_Block *block, const unsigned options)
+{
+    const bool weighted = options & GR_KERNEL_WEIGHTED;
+    const bool fast = options & GR_KERNEL_FAST_MATH;
+    gr_Vec2 *pos = state->pos;
+    const gr_Index *ids = state->ids;
+    const float *mass = state->mass;
+    const size_t end = block->start + block->count;
+    const float threshold = state->freeze_threshold * eades->c2;
+    const bool near = state->verlet_counts != NULL;
+    if (near) {
+        gr_verlet_update(state, block, state->verlet_cutoff * eades->c2);
+    }
+    const bool sampled = gr_block_sampled(state, block);
+    // every sample stands for this many verticies
+    const float scale = sampled ? (float)(block->count - 1) / state->samples : 1;
+    block->min = gr_vec2(FLT_MAX, FLT_MAX);
+    block->max = gr_vec2(-FLT_MAX, -FLT_MAX);
+    // sources do not fit into the L1 cache
+    const bool tiled = !near && !sampled && block->count > state->tile_cols;
+    block->active = 0;
+    for (size_t n = block->start; n < end; n += 1) {
+        if (tiled && (n - block->start) % state->tile_rows == 0) {
+            const size_t last = n + state->tile_rows < end ? n + state->tile_rows : end;
+            gr_tile_eades(eades, state, block, n, last, weighted, fast);
+        }
+        if ((state->calm != NULL && state->calm[n] >= GR_FREEZE_STEPS) ||
+            gr_is_pinned(state->pinned, ids[n])) {
+            gr_block_include(block, pos[n]);
+            continue;
+        }
+        block->active += 1;
+        const bool *edges = graph->edges[ids[n]];
+        gr_Vec2 force = tiled ? state->forces[n] : gr_vec2zero();
+        if (near) {
+            const gr_Index *list = &state->verlet_lists[n * GR_VERLET_NEIGHBORS];
+            for (size_t l = 0; l < state->verlet_counts[n]; l += 1) {
+                const size_t i  = list[l];
+                if (edges[ids[i]]) {
+                    // attracted along the edges below
+                    continue;
+                }
+                const float d_x = pos[i].x - pos[n].x;
+                const float d_y = pos[i].y - pos[n].y;
+                const float m   = weighted ? mass[i] : 1;
+                const gr_Vec2 f = gr_pair_eades(eades->c3, d_x, d_y, m, fast);
+                force.x += f.x;
+                force.y += f.y;
+            }
+        } else if (sampled) {
+            uint64_t rng = gr_sample_seed(state, n);
+            for (size_t k = 0; k < state->samples; k += 1) {
+                const size_t i  = gr_sample_other(&rng, block, n);
+                const float d_x = pos[i].x - pos[n].x;
+                const float d_y = pos[i].y - pos[n].y;
+                const float m   = scale * (weighted ? mass[i] : 1);
+                const gr_Vec2 f = gr_pair_eades(eades->c3, d_x, d_y, m, fast);
+                force.x += f.x;
+                force.y += f.y;
+            }
+        } else if (!tiled) {
+            force = gr_repel_exact(GR_RM_Eades, eades->c3, state, n, block->start, end, force,
+                                   weighted, fast);
+        }
+        // adjacent verticies do not repel each other, the repulsion above
+        // included them anyway unless it came from the neighbor list
+        const float cancel = near ? 0 : eades->c3;
+        for (size_t e = state->edge_offsets[n]; e < state->edge_offsets[n + 1]; e += 1) {
+            const size_t i  = state->edge_targets[e];
+            const float d_x = pos[i].x - pos[n].x;
+            const float d_y = pos[i].y - pos[n].y;
+            const float inv_d = gr_frsqrt(gr_sq(d_x) + gr_sq(d_y), fast);
+            const float d   = gr_fdist(gr_sq(d_x) + gr_sq(d_y), inv_d, fast);
+            const float m   = weighted ? mass[i] : 1;
+            const float f   = eades->c1 * gr_flog(gr_fdiv(d, eades->c2, fast), fast) +
+                              gr_fdiv_d_sq(cancel, d, inv_d, fast);
+            force.x += m * f * gr_fdiv_d(d_x, d, inv_d, fast);
+            force.y += m * f * gr_fdiv_d(d_y, d, inv_d, fast);
+        }
+        const float g_x = eades->grav_cen.x - pos[n].x;
+        const float g_y = eades->grav_cen.y - pos[n].y;
+        const float g_d = gr_not0f(sqrtf(gr_sq(g_x) + gr_sq(g_y)));
+        force.x += (eades->c1 * logf(g_d / eades->c2)) * (g_x / g_d);
+        force.y += (eades->c1 * logf(g_d / eades->c2)) * (g_y / g_d);
+        if (state->spring_offsets != NULL) {
+            for (size_t e = state->spring_offsets[n]; e < state->spring_offsets[n + 1]; e += 1) {
+                const size_t i  = state->springs[e];
+                const float d_x = pos[i].x - pos[n].x;
+                const float d_y = pos[i].y - pos[n].y;
+                const float inv_d = gr_frsqrt(gr_sq(d_x) + gr_sq(d_y), fast);
+                const float d   = gr_fdist(gr_sq(d_x) + gr_sq(d_y), inv_d, fast);
+                const float m   = weighted ? mass[i] : 1;
+                float spring = eades->c1 * logf(d / (eades->c2 * state->spring_lengths[e]));
+                // the repulsion of the ends of a chain is only taken back if
+                // it was applied
+                if (state->spring_cancels[e] && edges[ids[i]]) {
+                    spring -= eades->c1 * gr_flog(gr_fdiv(d, eades->c2, fast), fast);
+                } else if (state->spring_cancels[e] &&
+                           (!near || gr_verlet_contains(state, n, i))) {
+                    spring += gr_fdiv_d_sq(eades->c3, d, inv_d, fast);
+                }
+                force.x += m * spring * gr_fdiv_d(d_x, d, inv_d, fast);
+                force.y += m * spring * gr_fdiv_d(d_y, d, inv_d, fast);
+            }
+        }
+        const gr_Vec2 move = gr_vec2(eades->c4 * force.x, eades->c4 * force.y);
+        pos[n].x += move.x;
+        pos[n].y += move.y;
+        gr_block_include(block, pos[n]);
+        if (state->calm != NULL) {
+            gr_track_activity(state, n, move, threshold);
+        }
+    }
+}
+
+// Repulsion of the targets `[first, last)` of the block by all its verticies,
+// one tile of sources after the other, into `state->forces`
+GR_TEMPLATE void gr_tile_fruchtman_and_reingold(const float k, struct gr_RenderState *state,
+                                                const gr_Block *block, const size_t first,
+                                                const size_t last, const bool weighted,
+                                                const bool fast)
+{
+    gr_Vec2 *forces = state->forces;
+    const size_t end = block->start + block->count;
+    for (size_t n = first; n < last; n += 1) {
+        forces[n] = gr_vec2zero();
+    }
+    for (size_t s = block->start; s < end; s += state->tile_cols) {
+        const size_t s_end = s + state->tile_cols < end ? s + state->tile_cols : end;
+        for (size_t n = first; n < last; n += 1) {
+            if ((state->calm != NULL && state->calm[n] >= GR_FREEZE_STEPS) ||
+                gr_is_pinned(state->pinned, state->ids[n])) {
+                continue;
+            }
+            forces[n] = gr_repel_exact(GR_RM_Fruchterman_and_Reingold, k, state, n, s, s_end, forces[n],
+                                       weighted, fast);
+        }
+    }
+}
+
+GR_TEMPLATE void gr_step_method_fruchtman_and_reingold(const struct gr_RenderMethodFruchtgold *fag,
+                                                       const gr_Graph *graph,
+                                                       struct gr_RenderState *state,
+                                                       gr_Block *block, const unsigned options)
+{
+    const bool weighted = options & GR_KERNEL_WEIGHTED;
+    const bool fast = options & GR_KERNEL_FAST_MATH;
+    gr_Vec2 *pos = state->pos;
+    const gr_Index *ids = state->ids;
+    const float *mass = state->mass;
+    const size_t end = block->start + block->count;
+    const float k = fag->c * sqrtf(fag->area / block->count);
+    const float threshold = state->freeze_threshold * k;
+    const bool near = state->verlet_counts != NULL;
+    if (near) {
+        gr_verlet_update(state, block, state->verlet_cutoff * k);
+    }
+    const bool sampled = gr_block_sampled(state, block);
+    // every sample stands for this many verticies
+    const float scale = sampled ? (float)(block->count - 1) / state->samples : 1;
+    block->min = gr_vec2(FLT_MAX, FLT_MAX);
+    block->max = gr_vec2(-FLT_MAX, -FLT_MAX);
+    // sources do not fit into the L1 cache
+    const bool tiled = !near && !sampled && block->count > state->tile_cols;
+    block->active = 0;
+    for (size_t n = block->start; n < end; n += 1) {
+        if (tiled && (n - block->start) % state->tile_rows == 0) {
+            const size_t last = n + state->tile_rows < end ? n + state->tile_rows : end;
+            gr_tile_fruchtman_and_reingold(k, state, block, n, last, weighted, fast);
+        }
+        if ((state->calm != NULL && state->calm[n] >= GR_FREEZE_STEPS) ||
+            gr_is_pinned(state->pinned, ids[n])) {
+            gr_block_include(block, pos[n]);
+            continue;
+        }
+        block->active += 1;
+        const bool *edges = graph->edges[ids[n]];
+        gr_Vec2 force = tiled ? state->forces[n] : gr_vec2zero();
+        if (near) {
+            const gr_Index *list = &state->verlet_lists[n * GR_VERLET_NEIGHBORS];
+            for (size_t l = 0; l < state->verlet_counts[n]; l += 1) {
+                const size_t i  = list[l];
+                if (edges[ids[i]]) {
+                    // attracted along the edges below
+                    continue;
+                }
+                const float d_x = pos[i].x - pos[n].x;
+                const float d_y = pos[i].y - pos[n].y;
+                const float m   = weighted ? mass[i] : 1;
+                const gr_Vec2 f = gr_pair_fruchtgold(k, d_x, d_y, m, fast);
+                force.x += f.x;
+                force.y += f.y;
+            }
+        } else if (sampled) {
+            uint64_t rng = gr_sample_seed(state, n);
+            for (size_t s = 0; s < state->samples; s += 1) {
+                const size_t i  = gr_sample_other(&rng, block, n);
+                const float d_x = pos[i].x - pos[n].x;
+                const float d_y = pos[i].y - pos[n].y;
+                const float m   = scale * (weighted ? mass[i] : 1);
+                const gr_Vec2 f = gr_pair_fruchtgold(k, d_x, d_y, m, fast);
+                force.x += f.x;
+                force.y += f.y;
+            }
+        } else if (!tiled) {
+            force = gr_repel_exact(GR_RM_Fruchterman_and_Reingold, k, state, n, block->start, end, force,
+                                   weighted, fast);
+        }
+        // adjacent verticies do not repel each other, the repulsion above
+        // included them anyway unless it came from the neighbor list
+        const float cancel = near ? 0 : gr_sq(k);
+        for (size_t e = state->edge_offsets[n]; e < state->edge_offsets[n + 1]; e += 1) {
+            const size_t i   = state->edge_targets[e];
+            const float d_x  = pos[i].x - pos[n].x;
+            const float d_y  = pos[i].y - pos[n].y;
+            const float d_sq = gr_sq(d_x) + gr_sq(d_y);
+            const float inv_d = gr_frsqrt(d_sq, fast);
+            const float d    = gr_fdist(d_sq, inv_d, fast);
+            const float m    = weighted ? mass[i] : 1;
+            const float f    = gr_fdiv(d_sq, k, fast) + gr_fdiv_d(cancel, d, inv_d, fast);
+            force.x += m * f * gr_fdiv_d(d_x, d, inv_d, fast);
+            force.y += m * f * gr_fdiv_d(d_y, d, inv_d, fast);
+        }
+        const float g_x  = fag->grav_cen.x - pos[n].x;
+        const float g_y  = fag->grav_cen.y - pos[n].y;
+        const float g_sq = gr_sq(g_x) + gr_sq(g_y);
+        const float g_d  = gr_not0f(sqrtf(g_sq));
+        force.x += (g_sq / k) * (g_x / g_d);
+        force.y += (g_sq / k) * (g_y / g_d);
+        if (state->spring_offsets != NULL) {
+            for (size_t e = state->spring_offsets[n]; e < state->spring_offsets[n + 1]; e += 1) {
+                const size_t i  = state->springs[e];
+                const float d_x = pos[i].x - pos[n].x;
+                const float d_y = pos[i].y - pos[n].y;
+                const float d_sq = gr_sq(d_x) + gr_sq(d_y);
+                const float inv_d = gr_frsqrt(d_sq, fast);
+                const float d   = gr_fdist(d_sq, inv_d, fast);
+                const float m   = weighted ? mass[i] : 1;
+                // springs in series: `l` edges of length `k` are `l` times as
+                // long and `l * l` times as soft as a single one
+                const float l = state->spring_lengths[e];
+                float spring = d_sq / (k * l * l * l);
+                // the repulsion of the ends of a chain is only taken back if
+                // it was applied
+                if (state->spring_cancels[e] && edges[ids[i]]) {
+                    spring -= d_sq / k;
+                } else if (state->spring_cancels[e] &&
+                           (!near || gr_verlet_contains(state, n, i))) {
+                    spring += gr_fdiv_d(gr_sq(k), d, inv_d, fast);
+                }
+                force.x += m * spring * gr_fdiv_d(d_x, d, inv_d, fast);
+                force.y += m * spring * gr_fdiv_d(d_y, d, inv_d, fast);
+            }
+        }
+        const gr_Vec2 move = gr_vec2(fag->cur_temp * force.x, fag->cur_temp * force.y);
+        pos[n].x += move.x;
+        pos[n].y += move.y;
+        gr_block_include(block, pos[n]);
+        if (state->calm != NULL) {
+            gr_track_activity(state, n, move, threshold);
+        }
+    }
+}
+
+#if !defined(GR_NO_THREADS) && defined(__GNUC__)
+// Hogwild: threads update the same verticies without locks, an update may
+// get lost but never torn
+static float gr_load_relaxed(const float *p)
+{
+    float v;
+    __atomic_load(p, &v, __ATOMIC_RELAXED);
+    return v;
+}
+
+static void gr_store_relaxed(float *p, float v)
+{
+    __atomic_store(p, &v, __ATOMIC_RELAXED);
+}
+#else
+#   define gr_load_relaxed(p) (*(p))
+#   define gr_store_relaxed(p, v) (*(p) = (v))
+#endif // GR_NO_THREADS
+
+typedef struct {
+    const struct gr_RenderMethodSGD *sgd;
+    struct gr_RenderState *state;
+    float eta;
+    size_t chunk;
+} gr_SGDTask;
+
+// Task of the thread pool, applies a chunk of the shuffled stress terms
+static void gr_step_method_sgd(void *arg, size_t task, size_t thread)
+{
+    const gr_SGDTask *sgd_task = arg;
+    const struct gr_RenderState *state = sgd_task->state;
+    gr_Vec2 *pos = state->pos;
+    const float eta = sgd_task->eta;
+    const float length = sgd_task->sgd->length;
+    const size_t start = task * sgd_task->chunk;
+    const size_t end = start + sgd_task->chunk < state->n_terms
+        ? start + sgd_task->chunk
+        : state->n_terms;
+    (void)thread;
+
+    for (size_t t = start; t < end; t += 1) {
+        const gr_StressTerm *term = &state->terms[t];
+        const gr_Vec2 p_i = gr_vec2(gr_load_relaxed(&pos[term->i].x),
+                                    gr_load_relaxed(&pos[term->i].y));
+        const gr_Vec2 p_j = gr_vec2(gr_load_relaxed(&pos[term->j].x),
+                                    gr_load_relaxed(&pos[term->j].y));
+        const float d_x = p_i.x - p_j.x;
+        const float d_y = p_i.y - p_j.y;
+        const float d   = gr_not0f(sqrtf(gr_sq(d_x) + gr_sq(d_y)));
+        // both move half of the way unless one of them stays put
+        const float r   = (d - length * term->d) / d;
+        const float share = term->w_i == 0 || term->w_j == 0 ? 1 : 0.5f;
+        if (term->w_i > 0) {
+            const float mu = fminf(eta * term->w_i, 1) * share * r;
+            gr_store_relaxed(&pos[term->i].x, p_i.x - mu * d_x);
+            gr_store_relaxed(&pos[term->i].y, p_i.y - mu * d_y);
+        }
+        if (term->w_j > 0) {
+            const float mu = fminf(eta * term->w_j, 1) * share * r;
+            gr_store_relaxed(&pos[term->j].x, p_j.x + mu * d_x);
+            gr_store_relaxed(&pos[term->j].y, p_j.y + mu * d_y);
+        }
+    }
+}
+
+// One pass over all stress terms in a new random order
+static void gr_step_sgd(gr_RenderContext *ctx)
+{
+    struct gr_RenderState *state = ctx->state;
+    const struct gr_RenderMethodSGD *sgd = &ctx->method.sgd;
+    for (size_t t = state->n_terms; t > 1; t -= 1) {
+        const size_t k = gr_xorshift(&state->seed) % t;
+        const gr_StressTerm tmp = state->terms[t - 1];
+        state->terms[t - 1] = state->terms[k];
+        state->terms[k] = tmp;
+    }
+
+    // eta_max * exp(-lambda * t), reaching eta_min at the last iteration
+    float eta = state->eta_min;
+    if (sgd->iterations > 1 && ctx->cur_iteration + 1 < sgd->iterations) {
+        const float lambda = logf(state->eta_max / state->eta_min) / (sgd->iterations - 1);
+        eta = state->eta_max * expf(-lambda * ctx->cur_iteration);
+    }
+
+    const size_t n_tasks = state->pool == NULL ? 1 : state->n_threads;
+    gr_SGDTask task = {
+        .sgd = sgd,
+        .state = state,
+        .eta = eta,
+        .chunk = (state->n_terms + n_tasks - 1) / n_tasks,
+    };
+    gr_pool_run(state->pool, gr_step_method_sgd, &task, n_tasks);
+
+    for (size_t b = 0; b < state->n_blocks; b += 1) {
+        gr_Block *block = &state->blocks[b];
+        block->min = gr_vec2(FLT_MAX, FLT_MAX);
+        block->max = gr_vec2(-FLT_MAX, -FLT_MAX);
+        block->active = block->count;
+        for (size_t i = block->start; i < block->start + block->count; i += 1) {
+            gr_block_include(block, state->pos[i]);
+        }
+    }
+}
+
+#define GR_FORCEATLAS2_SPEED        0.1f
+#define GR_FORCEATLAS2_MAX_SPEED    10.0f
+#define GR_FORCEATLAS2_SPEEDUP      1.5f
+
+// The forces of all verticies are calculated from the positions of the last
+// step before any of them moves, so they can be compared to the last ones.
+// Whether the exact repulsion of ForceAtlas2 should evaluate every pair of the
+// block once and push both verticies apart. It is symmetric, but it also
+// calculates the forces of resting verticies, so it only pays off if at least
+// half of them move.
+static bool gr_block_symmetric(const struct gr_RenderState *state, const gr_Block *block)
+{
+    if (state->kind != GR_RM_ForceAtlas2 || state->verlet_counts != NULL ||
+        gr_block_sampled(state, block)) {
+        return false;
+    }
+    size_t moving = 0;
+    for (size_t n = block->start; n < block->start + block->count; n += 1) {
+        moving += !((state->calm != NULL && state->calm[n] >= GR_FREEZE_STEPS) ||
+                    gr_is_pinned(state->pinned, state->ids[n]));
+    }
+    return 2 * moving > block->count;
+}
+
+// ForceAtlas2 repulsion per unit of distance between two verticies `(d_x, d_y)`
+// apart, `k` is the scaling times both degrees
+GR_TEMPLATE float gr_pair_force_atlas_2(const float k, const float d_x, const float d_y,
+                                        const bool fast)
+{
+    const float d_sq = gr_sq(d_x) + gr_sq(d_y);
+    return fast ? k * gr_approx_rcp(d_sq + 1e-24f) : k / (float)gr_not0f(d_sq);
+}
+
+// Adds the ForceAtlas2 repulsion of all pairs `n < i` of the block to `acc`,
+// for the rows `n` of share `task` out of `n_tasks`. Rows are dealt out in
+// tiles back and forth (0, 1, ..., n_tasks - 1, n_tasks - 1, ..., 0, 0, 1,
+// ...), so the shares get about the same number of pairs. Tiles of columns
+// stay in the L1 cache while a tile of rows is pushed by them.
+GR_TEMPLATE void gr_repulsion_force_atlas_2(const struct gr_RenderMethodForceAtlas2 *fa2,
+                                            const struct gr_RenderState *state,
+                                            const gr_Block *block, const size_t task,
+                                            const size_t n_tasks, gr_Vec2 *restrict acc,
+                                            const unsigned options)
+{
+    const bool weighted = options & GR_KERNEL_WEIGHTED;
+    const bool fast = options & GR_KERNEL_FAST_MATH;
+    const gr_Vec2 *pos = state->pos;
+    const float *mass = state->mass;
+    const float *deg = state->degrees;
+    const size_t end = block->start + block->count;
+    const bool tiled = block->count > state->tile_cols;
+    const size_t cols = tiled ? state->tile_cols : block->count;
+    size_t rows = 1;
+    if (tiled) {
+        // enough tiles to balance the shares
+        rows = block->count / (4 * n_tasks);
+        rows = rows < cols ? cols : rows > state->tile_rows ? state->tile_rows : rows;
+    }
+    for (size_t r = block->start; r < end; r += rows) {
+        const size_t fold = (r - block->start) / rows % (2 * n_tasks);
+        if (fold != task && fold != 2 * n_tasks - 1 - task) {
+            continue;
+        }
+        const size_t r_end = r + rows < end ? r + rows : end;
+        for (size_t c = r; c < end; c += cols) {
+            const size_t c_end = c + cols < end ? c + cols : end;
+            for (size_t n = r; n < r_end; n += 1) {
+                const float m_n = weighted ? mass[n] : 1;
+                const float k_n = fa2->scaling * deg[n];
+                gr_Vec2 force = acc[n];
+                size_t i = n + 1 > c ? n + 1 : c;
+                if (fast) {
+                    // see `gr_repel_exact`
+                    float lane_x[GR_LANES] = { 0 };
+                    float lane_y[GR_LANES] = { 0 };
+                    for (; i + GR_LANES <= c_end; i += GR_LANES) {
+                        for (size_t l = 0; l < GR_LANES; l += 1) {
+                            const float d_x = pos[i + l].x - pos[n].x;
+                            const float d_y = pos[i + l].y - pos[n].y;
+                            const float m_i = weighted ? mass[i + l] : 1;
+                            const float f   = gr_pair_force_atlas_2(k_n * deg[i + l], d_x, d_y,
+                                                                    true);
+                            lane_x[l] -= m_i * f * d_x;
+                            lane_y[l] -= m_i * f * d_y;
+                            acc[i + l].x += m_n * f * d_x;
+                            acc[i + l].y += m_n * f * d_y;
+                        }
+                    }
+                    for (size_t l = 0; l < GR_LANES; l += 1) {
+                        force.x += lane_x[l];
+                        force.y += lane_y[l];
+                    }
+                }
+                for (; i < c_end; i += 1) {
+                    const float d_x = pos[i].x - pos[n].x;
+                    const float d_y = pos[i].y - pos[n].y;
+                    // a collapsed vertex acts like all verticies it stands for
+                    const float m_i = weighted ? mass[i] : 1;
+                    const float f   = gr_pair_force_atlas_2(k_n * deg[i], d_x, d_y, fast);
+                    force.x -= m_i * f * d_x;
+                    force.y -= m_i * f * d_y;
+                    acc[i].x += m_n * f * d_x;
+                    acc[i].y += m_n * f * d_y;
+                }
+                acc[n] = force;
+            }
+        }
+    }
+}
+
+// Task of the thread pool, one share of the repulsion of the only block
+static void gr_repulsion_task(void *arg, size_t task, size_t thread)
+{
+    gr_RenderContext *ctx = arg;
+    struct gr_RenderState *state = ctx->state;
+    const gr_Block *block = &state->blocks[0];
+    gr_Vec2 *acc = &state->partial_forces[task * state->n];
+    (void)thread;
+
+    for (size_t n = block->start; n < block->start + block->count; n += 1) {
+        acc[n] = gr_vec2zero();
+    }
+    const struct gr_RenderMethodForceAtlas2 *fa2 = &ctx->method.force_atlas;
+    // the options of the kernel, see `gr_select_kernel`
+    switch (state->options & (GR_KERNEL_WEIGHTED | GR_KERNEL_FAST_MATH)) {
+        case 0:
+            gr_repulsion_force_atlas_2(fa2, state, block, task, state->n_threads, acc, 0);
+            break;
+        case GR_KERNEL_WEIGHTED:
+            gr_repulsion_force_atlas_2(fa2, state, block, task, state->n_threads, acc,
+                                       GR_KERNEL_WEIGHTED);
+            break;
+        case GR_KERNEL_FAST_MATH:
+            gr_repulsion_force_atlas_2(fa2, state, block, task, state->n_threads, acc,
+                                       GR_KERNEL_FAST_MATH);
+            break;
+        default:
+            gr_repulsion_force_atlas_2(fa2, state, block, task, state->n_threads, acc,
+                                       GR_KERNEL_WEIGHTED | GR_KERNEL_FAST_MATH);
+            break;
+    }
+}
+
+GR_TEMPLATE void gr_step_method_force_atlas_2(const struct gr_RenderMethodForceAtlas2 *fa2,
+                                              const gr_Graph *graph,
+                                              struct gr_RenderState *state,
+                                              gr_Block *block, const unsigned options)
+{
+    const bool weighted = options & GR_KERNEL_WEIGHTED;
+    const bool fast = options & GR_KERNEL_FAST_MATH;
+    const bool lin_log = options & GR_KERNEL_LIN_LOG;
+    gr_Vec2 *pos = state->pos;
+    gr_Vec2 *forces = state->forces;
+    gr_Vec2 *prev_forces = state->prev_forces;
+    const gr_Index *ids = state->ids;
+    const float *mass = state->mass;
+    const float *deg = state->degrees;
+    const size_t end = block->start + block->count;
+    const float k_r = fa2->scaling;
+    const bool near = state->verlet_counts != NULL;
+    if (near) {
+        gr_verlet_update(state, block, state->verlet_cutoff * 2 * sqrtf(k_r));
+    }
+    const bool sampled = gr_block_sampled(state, block);
+    // every sample stands for this many verticies
+    const float scale = sampled ? (float)(block->count - 1) / state->samples : 1;
+    if (block->symmetric && state->partial_forces != NULL) {
+        for (size_t n = block->start; n < end; n += 1) {
+            forces[n] = gr_vec2zero();
+            for (size_t t = 0; t < state->n_threads; t += 1) {
+                forces[n].x += state->partial_forces[t * state->n + n].x;
+                forces[n].y += state->partial_forces[t * state->n + n].y;
+            }
+        }
+    } else if (block->symmetric) {
+        for (size_t n = block->start; n < end; n += 1) {
+            forces[n] = gr_vec2zero();
+        }
+        gr_repulsion_force_atlas_2(fa2, state, block, 0, 1, forces, options);
+    }
+    block->active = 0;
+    for (size_t n = block->start; n < end; n += 1) {
+        if ((state->calm != NULL && state->calm[n] >= GR_FREEZE_STEPS) ||
+            gr_is_pinned(state->pinned, ids[n])) {
+            continue;
+        }
+        block->active += 1;
+        const bool *edges = graph->edges[ids[n]];
+        // attraction of a vertex is spread over its edges to dissuade hubs
+        const float a = fa2->dissuade_hubs ? 1 / deg[n] : 1;
+        // the symmetric repulsion is already there
+        gr_Vec2 force = block->symmetric ? forces[n] : gr_vec2zero();
+        if (near) {
+            const gr_Index *list = &state->verlet_lists[n * GR_VERLET_NEIGHBORS];
+            for (size_t l = 0; l < state->verlet_counts[n]; l += 1) {
+                const size_t i  = list[l];
+                const float d_x = pos[i].x - pos[n].x;
+                const float d_y = pos[i].y - pos[n].y;
+                const float inv_d = gr_frsqrt(gr_sq(d_x) + gr_sq(d_y), fast);
+                const float d   = gr_fdist(gr_sq(d_x) + gr_sq(d_y), inv_d, fast);
+                const float m   = weighted ? mass[i] : 1;
+                const float f   = gr_fdiv_d(-k_r * deg[n] * deg[i], d, inv_d, fast);
+                force.x += m * f * gr_fdiv_d(d_x, d, inv_d, fast);
+                force.y += m * f * gr_fdiv_d(d_y, d, inv_d, fast);
+            }
+        } else if (sampled) {
+            uint64_t rng = gr_sample_seed(state, n);
+            for (size_t s = 0; s < state->samples; s += 1) {
+                const size_t i  = gr_sample_other(&rng, block, n);
+                const float d_x = pos[i].x - pos[n].x;
+                const float d_y = pos[i].y - pos[n].y;
+                const float inv_d = gr_frsqrt(gr_sq(d_x) + gr_sq(d_y), fast);
+                const float d   = gr_fdist(gr_sq(d_x) + gr_sq(d_y), inv_d, fast);
+                const float m   = scale * (weighted ? mass[i] : 1);
+                const float f   = gr_fdiv_d(-k_r * deg[n] * deg[i], d, inv_d, fast);
+                force.x += m * f * gr_fdiv_d(d_x, d, inv_d, fast);
+                force.y += m * f * gr_fdiv_d(d_y, d, inv_d, fast);
+            }
+        } else if (!block->symmetric) {
+            for (size_t i = block->start; i < end; i += 1) {
+                // `n` itself adds nothing as its direction is zero
+                const float d_x = pos[i].x - pos[n].x;
+                const float d_y = pos[i].y - pos[n].y;
+                const float inv_d = gr_frsqrt(gr_sq(d_x) + gr_sq(d_y), fast);
+                const float d   = gr_fdist(gr_sq(d_x) + gr_sq(d_y), inv_d, fast);
+                // a collapsed vertex acts like all verticies it stands for
+                const float m   = weighted ? mass[i] : 1;
+                const float f   = gr_fdiv_d(-k_r * deg[n] * deg[i], d, inv_d, fast);
+                force.x += m * f * gr_fdiv_d(d_x, d, inv_d, fast);
+                force.y += m * f * gr_fdiv_d(d_y, d, inv_d, fast);
+            }
+        }
+        for (size_t e = state->edge_offsets[n]; e < state->edge_offsets[n + 1]; e += 1) {
+            const size_t i  = state->edge_targets[e];
+            const float d_x = pos[i].x - pos[n].x;
+            const float d_y = pos[i].y - pos[n].y;
+            const float inv_d = gr_frsqrt(gr_sq(d_x) + gr_sq(d_y), fast);
+            const float d   = gr_fdist(gr_sq(d_x) + gr_sq(d_y), inv_d, fast);
+            const float m   = weighted ? mass[i] : 1;
+            const float f   = a * (lin_log ? gr_flog(1 + d, fast) : d);
+            force.x += m * f * gr_fdiv_d(d_x, d, inv_d, fast);
+            force.y += m * f * gr_fdiv_d(d_y, d, inv_d, fast);
+        }
+        if (state->spring_offsets != NULL) {
+            for (size_t e = state->spring_offsets[n]; e < state->spring_offsets[n + 1]; e += 1) {
+                const size_t i  = state->springs[e];
+                const float d_x = pos[i].x - pos[n].x;
+                const float d_y = pos[i].y - pos[n].y;
+                const float inv_d = gr_frsqrt(gr_sq(d_x) + gr_sq(d_y), fast);
+                const float d   = gr_fdist(gr_sq(d_x) + gr_sq(d_y), inv_d, fast);
+                const float m   = weighted ? mass[i] : 1;
+                // longer edges are weaker, repulsion applies to all pairs
+                // anyway, so only the attraction of the loop is taken back
+                const float attraction = a * (lin_log ? gr_flog(1 + d, fast) : d);
+                float spring = attraction / state->spring_lengths[e];
+                if (state->spring_cancels[e] && edges[ids[i]]) {
+                    spring -= attraction;
+                }
+                force.x += m * spring * gr_fdiv_d(d_x, d, inv_d, fast);
+                force.y += m * spring * gr_fdiv_d(d_y, d, inv_d, fast);
+            }
+        }
+        const float g_x = fa2->grav_cen.x - pos[n].x;
+        const float g_y = fa2->grav_cen.y - pos[n].y;
+        const float g_d = gr_not0f(sqrtf(gr_sq(g_x) + gr_sq(g_y)));
+        const float g   = fa2->gravity * deg[n] * (fa2->strong_gravity ? 1 : 1 / g_d);
+        force.x += g * g_x;
+        force.y += g * g_y;
+        forces[n] = force;
+    }
+
+    // the global speed grows while the verticies move in a steady direction
+    // and shrinks when they swing back and forth
+    float swing = 0;
+    float traction = 0;
+    for (size_t n = block->start; n < end; n += 1) {
+        if ((state->calm != NULL && state->calm[n] >= GR_FREEZE_STEPS) ||
+            gr_is_pinned(state->pinned, ids[n])) {
+            continue;
+        }
+        const gr_Vec2 f = forces[n];
+        const gr_Vec2 p = prev_forces[n];
+        swing += deg[n] * sqrtf(gr_sq(f.x - p.x) + gr_sq(f.y - p.y));
+        traction += deg[n] * sqrtf(gr_sq(f.x + p.x) + gr_sq(f.y + p.y)) / 2;
+    }
+    if (swing > 0) {
+        const float speed = fa2->tolerance * traction / swing;
+        block->speed = fminf(speed, GR_FORCEATLAS2_SPEEDUP * block->speed);
+    }
+
+    const float threshold = state->freeze_threshold * 2 * sqrtf(k_r);
+    block->min = gr_vec2(FLT_MAX, FLT_MAX);
+    block->max = gr_vec2(-FLT_MAX, -FLT_MAX);
+    for (size_t n = block->start; n < end; n += 1) {
+        if ((state->calm != NULL && state->calm[n] >= GR_FREEZE_STEPS) ||
+            gr_is_pinned(state->pinned, ids[n])) {
+            gr_block_include(block, pos[n]);
+            continue;
+        }
+        const gr_Vec2 f = forces[n];
+        const gr_Vec2 p = prev_forces[n];
+        const float vertex_swing = sqrtf(gr_sq(f.x - p.x) + gr_sq(f.y - p.y));
+        const float f_d = gr_not0f(sqrtf(gr_sq(f.x) + gr_sq(f.y)));
+        const float speed = fminf(
+            GR_FORCEATLAS2_SPEED * block->speed / (1 + block->speed * sqrtf(vertex_swing)),
+            GR_FORCEATLAS2_MAX_SPEED / f_d);
+        const gr_Vec2 move = gr_vec2(speed * f.x, speed * f.y);
+        pos[n].x += move.x;
+        pos[n].y += move.y;
+        prev_forces[n] = f;
+        gr_block_include(block, pos[n]);
+        if (state->calm != NULL) {
+            gr_track_activity(state, n, move, threshold);
+        }
+    }
+}
+
+// Sorts the blocks by the work on their movable verticies, so the threads
+// start with the most expensive ones and the rest fills up the gaps
+static void gr_order_blocks(gr_RenderContext *ctx)
+{
+    struct gr_RenderState *state = ctx->state;
+    for (size_t b = 0; b < state->n_blocks; b += 1) {
+        const gr_Block *block = &state->blocks[b];
+        size_t movable = 0;
+        for (size_t i = block->start; i < block->start + block->count; i += 1) {
+            movable += !gr_is_pinned(state->pinned, state->ids[i]) &&
+                       (state->calm == NULL || state->calm[i] < GR_FREEZE_STEPS);
+        }
+        state->block_work[b] = (gr_ComponentSize) {
+            .count = movable * block->count,
+            .component = b,
+        };
+    }
+    qsort(state->block_work, state->n_blocks, sizeof(gr_ComponentSize),
+          gr_component_size_cmp);
+    for (size_t b = 0; b < state->n_blocks; b += 1) {
+        state->block_order[b] = state->block_work[b].component;
+    }
+}
+
+// Instantiates `kernel` for the method `member` and a fixed combination of
+// `GR_KERNEL_*` options as `kernel_options`, the compiler folds them out of
+// the inner loops
+#define GR_KERNEL(kernel, member, options)                                              \
+    static void kernel##_##options(const gr_RenderMethod *method, const gr_Graph *graph, \
+                                   struct gr_RenderState *state, gr_Block *block)       \
+    {                                                                                   \
+        kernel(&method->member, graph, state, block, options);                          \
+    }
+#define GR_KERNELS(kernel, member)                                  \
+    GR_KERNEL(kernel, member, 0) GR_KERNEL(kernel, member, 1)       \
+    GR_KERNEL(kernel, member, 2) GR_KERNEL(kernel, member, 3)
+
+GR_KERNELS(gr_step_method_eades, eades)
+GR_KERNELS(gr_step_method_fruchtman_and_reingold, fruchtgold)
+GR_KERNELS(gr_step_method_force_atlas_2, force_atlas)
+GR_KERNEL(gr_step_method_force_atlas_2, force_atlas, 4)
+GR_KERNEL(gr_step_method_force_atlas_2, force_atlas, 5)
+GR_KERNEL(gr_step_method_force_atlas_2, force_atlas, 6)
+GR_KERNEL(gr_step_method_force_atlas_2, force_atlas, 7)
+
+// Indexed by the options
+static const gr_Kernel gr_kernels_eades[] = {
+    gr_step_method_eades_0, gr_step_method_eades_1,
+    gr_step_method_eades_2, gr_step_method_eades_3,
+};
+static const gr_Kernel gr_kernels_fruchtgold[] = {
+    gr_step_method_fruchtman_and_reingold_0, gr_step_method_fruchtman_and_reingold_1,
+    gr_step_method_fruchtman_and_reingold_2, gr_step_method_fruchtman_and_reingold_3,
+};
+static const gr_Kernel gr_kernels_force_atlas[] = {
+    gr_step_method_force_atlas_2_0, gr_step_method_force_atlas_2_1,
+    gr_step_method_force_atlas_2_2, gr_step_method_force_atlas_2_3,
+    gr_step_method_force_atlas_2_4, gr_step_method_force_atlas_2_5,
+    gr_step_method_force_atlas_2_6, gr_step_method_force_atlas_2_7,
+};
+
+// Kernel for the method and options of the current step, so the verticies
+// and pairs do not check them again. Sets `state->options`.
+static gr_Kernel gr_select_kernel(const gr_RenderContext *ctx)
+{
+    struct gr_RenderState *state = ctx->state;
+    state->options = (state->mass != NULL ? GR_KERNEL_WEIGHTED : 0) |
+                     (ctx->fast_math ? GR_KERNEL_FAST_MATH : 0);
+    switch(ctx->method.kind) {
+        case GR_RM_Eades:
+            return gr_kernels_eades[state->options];
+        case GR_RM_Fruchterman_and_Reingold:
+            return gr_kernels_fruchtgold[state->options];
+        case GR_RM_ForceAtlas2:
+            state->options |= ctx->method.force_atlas.lin_log ? GR_KERNEL_LIN_LOG : 0;
+            return gr_kernels_force_atlas[state->options];
+        default:
+            fprintf(stderr, "Unreachable render method kind: %d\n", ctx->method.kind);
+            abort();
+    }
+}
+
+// Task of the thread pool, lays out a single block
+static void gr_step_block(void *arg, size_t task, size_t thread)
+{
+    gr_RenderContext *ctx = arg;
+    struct gr_RenderState *state = ctx->state;
+    const size_t b = state->block_order == NULL ? task : state->block_order[task];
+    (void)thread;
+
+    state->kernel(&ctx->method, ctx->graph, state, &state->blocks[b]);
+}
+
+typedef struct {
+    float w;
+    float h;
+    size_t block;
+} gr_PackRect;
+
+static int gr_pack_rect_cmp(const void *a, const void *b)
+{
+    const gr_PackRect *l = a;
+    const gr_PackRect *r = b;
+    if (l->h != r->h) {
+        return l->h > r->h ? -1 : 1;
+    }
+    return l->block < r->block ? -1 : (l->block > r->block);
+}
+
+// Segment of the skyline, covering `[x, x + w)` at height `y`
+typedef struct {
+    float x;
+    float y;
+    float w;
+} gr_SkylineSeg;
+
+// Skyline bottom-left packing of the block bounding boxes into a roughly
+// square rectangle centered on the center of gravity, or right beside the
+// blocks with pinned verticies, which stay where they are. Sets `offsets`,
+// which are kept as they are if a layout diverged.
+static void gr_pack_blocks(gr_RenderContext *ctx)
+{
+    struct gr_RenderState *state = ctx->state;
+    const float pad = gr_method_edge_length(&ctx->method, state->n);
+
+    gr_PackRect *rects = gr_arena_alloc(ctx, state->n_blocks * sizeof(gr_PackRect));
+    gr_SkylineSeg *segs = gr_arena_alloc(ctx, (2 * state->n_blocks + 1) *
+                                              sizeof(gr_SkylineSeg));
+
+    size_t n_blocks = 0;
+    gr_Vec2 fixed_min = gr_vec2(FLT_MAX, FLT_MAX);
+    gr_Vec2 fixed_max = gr_vec2(-FLT_MAX, -FLT_MAX);
+    float area = 0;
+    float width = 0;
+    for (size_t b = 0; b < state->n_blocks; b += 1) {
+        const gr_Block *block = &state->blocks[b];
+        if (!isfinite(block->max.x - block->min.x) || !isfinite(block->max.y - block->min.y)) {
+            return;
+        }
+        if (block->pinned) {
+            const gr_Vec2 offset = state->offsets[b];
+            gr_bbox_include(&fixed_min, &fixed_max,
+                            gr_vec2(block->min.x + offset.x, block->min.y + offset.y));
+            gr_bbox_include(&fixed_min, &fixed_max,
+                            gr_vec2(block->max.x + offset.x, block->max.y + offset.y));
+            continue;
+        }
+        gr_PackRect *rect = &rects[n_blocks++];
+        *rect = (gr_PackRect) {
+            .w = block->max.x - block->min.x + pad,
+            .h = block->max.y - block->min.y + pad,
+            .block = b,
+        };
+        area += rect->w * rect->h;
+        if (rect->w > width) {
+            width = rect->w;
+        }
+    }
+    if (n_blocks == 0) {
+        return;
+    }
+    if (!isfinite(area)) {
+        return;
+    }
+    if (sqrtf(area) > width) {
+        width = sqrtf(area);
+    }
+    qsort(rects, n_blocks, sizeof(*rects), gr_pack_rect_cmp);
+
+    size_t n_segs = 1;
+    segs[0] = (gr_SkylineSeg) { .x = 0, .y = 0, .w = width };
+    float height = 0;
+    for (size_t r = 0; r < n_blocks; r += 1) {
+        const float w = rects[r].w;
+        const float h = rects[r].h;
+
+        // lowest position, ties broken by the leftmost one
+        size_t best = SIZE_MAX;
+        float best_y = FLT_MAX;
+        for (size_t s = 0; s < n_segs; s += 1) {
+            if (segs[s].x + w > width * 1.0001f) {
+                break;
+            }
+            float y = 0;
+            float covered = 0;
+            for (size_t t = s; t < n_segs && covered < w; t += 1) {
+                if (segs[t].y > y) {
+                    y = segs[t].y;
+                }
+                covered += segs[t].w;
+            }
+            if (y < best_y) {
+                best_y = y;
+                best = s;
+            }
+        }
+        if (best == SIZE_MAX) {
+            // the first segment always fits, unless the sizes overflowed
+            return;
+        }
+
+        const float x = segs[best].x;
+        const gr_Block *block = &state->blocks[rects[r].block];
+        state->offsets[rects[r].block] = gr_vec2(x + pad / 2 - block->min.x,
+                                                 best_y + pad / 2 - block->min.y);
+        if (best_y + h > height) {
+            height = best_y + h;
+        }
+
+        // replace the covered segments by the new one
+        size_t last = best;
+        while (last < n_segs && segs[last].x + segs[last].w <= x + w) {
+            last += 1;
+        }
+        gr_SkylineSeg rest = { 0 };
+        const bool has_rest = last < n_segs && segs[last].x < x + w;
+        if (has_rest) {
+            rest = segs[last];
+            rest.w = rest.x + rest.w - (x + w);
+            rest.x = x + w;
+            last += 1;
+        }
+        const size_t n_new = 1 + has_rest;
+        memmove(&segs[best + n_new], &segs[last], (n_segs - last) * sizeof(*segs));
+        n_segs = n_segs - (last - best) + n_new;
+        segs[best] = (gr_SkylineSeg) { .x = x, .y = best_y + h, .w = w };
+        if (has_rest) {
+            segs[best + 1] = rest;
+        }
+        if (best > 0 && segs[best - 1].y == segs[best].y) {
+            segs[best - 1].w += segs[best].w;
+            memmove(&segs[best], &segs[best + 1], (n_segs - best - 1) * sizeof(*segs));
+            n_segs -= 1;
+        }
+    }
+
+    gr_Vec2 origin = gr_method_grav_cen(&ctx->method);
+    origin = gr_vec2(origin.x - width / 2, origin.y - height / 2);
+    if (fixed_min.x <= fixed_max.x) {
+        origin = gr_vec2(fixed_max.x + pad / 2, (fixed_min.y + fixed_max.y - height) / 2);
+    }
+    for (size_t r = 0; r < n_blocks; r += 1) {
+        state->offsets[rects[r].block].x += origin.x;
+        state->offsets[rects[r].block].y += origin.y;
+    }
+}
+
+// Fans the twins of every class out on a circle around their representative,
+// keeping neighboring twins at least half an edge apart
+static void gr_expand_twins(gr_RenderContext *ctx)
+{
+    struct gr_RenderState *state = ctx->state;
+    gr_Vec2 *pos = state->pos;
+    for (size_t c = 0; c < state->n_twin_classes; c += 1) {
+        const gr_TwinClass *twins = &state->twin_classes[c];
+        gr_Block *block = &state->blocks[twins->block];
+        const float length = gr_method_edge_length(&ctx->method, block->count);
+        const float radius = fmaxf(length / 4, twins->count * length / (4 * GR_PI));
+        const gr_Vec2 p = pos[twins->rep];
+        for (size_t i = 0; i < twins->count; i += 1) {
+            const float angle = 2 * GR_PI * i / twins->count;
+            pos[twins->first + i] = gr_vec2(p.x + radius * cosf(angle),
+                                            p.y + radius * sinf(angle));
+            gr_block_include(block, pos[twins->first + i]);
+        }
+    }
+}
+
+// Spreads the inner verticies of every chain evenly along the contracted edge
+static void gr_expand_chains(gr_RenderContext *ctx)
+{
+    struct gr_RenderState *state = ctx->state;
+    gr_Vec2 *pos = state->pos;
+    for (size_t c = 0; c < state->n_chains; c += 1) {
+        const gr_Chain *chain = &state->chains[c];
+        const gr_Vec2 a = pos[chain->a];
+        const gr_Vec2 b = pos[chain->b];
+        for (size_t i = 0; i < chain->count; i += 1) {
+            const float t = (float)(i + 1) / (chain->count + 1);
+            pos[chain->first + i] = gr_vec2(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t);
+        }
+    }
+}
+
+// Places the children of every leaf group evenly on an arc around their
+// parent, facing away from the parent's other neighbors. Afterwards they are
+// pushed off the neighbors of the parent for a few iterations while keeping
+// their distance to the parent.
+static void gr_reinsert_leaves(gr_RenderContext *ctx)
+{
+    struct gr_RenderState *state = ctx->state;
+    gr_Vec2 *pos = state->pos;
+    for (size_t g = 0; g < state->n_leaf_groups; g += 1) {
+        const gr_LeafGroup *group = &state->leaf_groups[g];
+        gr_Block *block = &state->blocks[group->block];
+        const gr_Index *refs = &state->leaf_refs[group->ref_first];
+        const float length = gr_method_edge_length(&ctx->method, block->count);
+        const gr_Vec2 p = pos[group->parent];
+
+        gr_Vec2 away = gr_vec2(1, 0);
+        if (group->ref_count > 0) {
+            gr_Vec2 mean = gr_vec2zero();
+            for (size_t r = 0; r < group->ref_count; r += 1) {
+                mean.x += pos[refs[r]].x / group->ref_count;
+                mean.y += pos[refs[r]].y / group->ref_count;
+            }
+            const float d = sqrtf(gr_sq(p.x - mean.x) + gr_sq(p.y - mean.y));
+            if (d > 0) {
+                away = gr_vec2((p.x - mean.x) / d, (p.y - mean.y) / d);
+            }
+        }
+
+        float wedge;
+        if (group->parent_pruned) {
+            wedge = fminf(GR_PI, group->count * GR_PI / 6);
+        } else if (group->ref_count == 0) {
+            wedge = 2 * GR_PI;
+        } else {
+            wedge = 2 * GR_PI * group->count / (group->count + group->parent_degree);
+        }
+        // keeps neighboring children at least half an edge apart
+        const float radius = fmaxf(length, group->count * length / (2 * wedge));
+        const float base = atan2f(away.y, away.x);
+
+        for (size_t c = 0; c < group->count; c += 1) {
+            const float angle = base + wedge * ((c + 0.5f) / group->count - 0.5f);
+            pos[group->first + c] = gr_vec2(p.x + radius * cosf(angle),
+                                            p.y + radius * sinf(angle));
+        }
+
+        for (size_t it = 0; it < GR_LEAF_REFINE_ITERS; it += 1) {
+            for (size_t c = 0; c < group->count; c += 1) {
+                gr_Vec2 q = pos[group->first + c];
+                gr_Vec2 push = gr_vec2zero();
+                for (size_t r = 0; r < group->ref_count; r += 1) {
+                    const float d_x = q.x - pos[refs[r]].x;
+                    const float d_y = q.y - pos[refs[r]].y;
+                    const float d   = gr_not0f(sqrtf(gr_sq(d_x) + gr_sq(d_y)));
+                    if (d < radius) {
+                        push.x += (radius - d) * d_x / d;
+                        push.y += (radius - d) * d_y / d;
+                    }
+                }
+                q.x += push.x / 2;
+                q.y += push.y / 2;
+                const float d = gr_not0f(sqrtf(gr_sq(q.x - p.x) + gr_sq(q.y - p.y)));
+                pos[group->first + c] = gr_vec2(p.x + (q.x - p.x) * radius / d,
+                                                p.y + (q.y - p.y) * radius / d);
+            }
+        }
+
+        for (size_t c = 0; c < group->count; c += 1) {
+            gr_block_include(block, pos[group->first + c]);
+        }
+    }
+}
+
+// Moves the positions of the laid out verticies from `vertex_pos` into the
+// local frames of their blocks
+static void gr_gather_positions(gr_RenderContext *ctx)
+{
+    struct gr_RenderState *state = ctx->state;
+    for (size_t b = 0; b < state->n_blocks; b += 1) {
+        const gr_Block *block = &state->blocks[b];
+        const gr_Vec2 offset = state->offsets == NULL ? gr_vec2zero() : state->offsets[b];
+        for (size_t i = block->start; i < block->start + block->count; i += 1) {
+            const gr_Vec2 p = ctx->vertex_pos[state->ids[i]];
+            state->pos[i] = gr_vec2(p.x - offset.x, p.y - offset.y);
+        }
+    }
+}
+
+// Writes the slots `[first, first + count)` of `block` back into `vertex_pos`
+static void gr_scatter_slots(gr_RenderContext *ctx, const size_t first,
+                             const size_t count, const size_t block)
+{
+    struct gr_RenderState *state = ctx->state;
+    const gr_Vec2 offset = state->offsets == NULL ? gr_vec2zero() : state->offsets[block];
+    const bool output = ctx->output.base != NULL;
+    for (size_t i = first; i < first + count; i += 1) {
+        const size_t v = state->ids[i];
+        if (!gr_is_pinned(state->pinned, v)) {
+            const gr_Vec2 p = state->pos[i];
+            ctx->vertex_pos[v] = gr_vec2(p.x + offset.x, p.y + offset.y);
+        }
+        if (output) {
+            gr_binding_set(&ctx->output, v, ctx->vertex_pos[v]);
+        }
+    }
+}
+
+static void gr_scatter_positions(gr_RenderContext *ctx)
+{
+    struct gr_RenderState *state = ctx->state;
+    for (size_t b = 0; b < state->n_blocks; b += 1) {
+        gr_scatter_slots(ctx, state->blocks[b].start, state->blocks[b].count, b);
+    }
+    for (size_t c = 0; c < state->n_twin_classes; c += 1) {
+        const gr_TwinClass *twins = &state->twin_classes[c];
+        gr_scatter_slots(ctx, twins->first, twins->count, twins->block);
+    }
+    for (size_t c = 0; c < state->n_chains; c += 1) {
+        const gr_Chain *chain = &state->chains[c];
+        gr_scatter_slots(ctx, chain->first, chain->count, chain->block);
+    }
+    for (size_t g = 0; g < state->n_leaf_groups; g += 1) {
+        const gr_LeafGroup *group = &state->leaf_groups[g];
+        gr_scatter_slots(ctx, group->first, group->count, group->block);
+    }
+}
+
+static void gr_render_step_unchecked(gr_RenderContext *ctx)
+{
+    const size_t heap_allocs = ctx->heap_allocs;
+    gr_perf_begin(ctx->perf, GR_PERF_STEP);
+    const bool reused = gr_render_prepare(ctx);
+    struct gr_RenderState *state = ctx->state;
+
+    const bool copied = state->pos != ctx->vertex_pos;
+
+    if (copied) {
+        gr_perf_begin(ctx->perf, GR_PERF_PACK);
+        gr_gather_positions(ctx);
+        // on the first step as well, which reserves the memory for it
+        if (state->order == GR_ORDER_HILBERT &&
+            (!reused || ctx->cur_iteration % GR_REORDER_STEPS == 0)) {
+            gr_order_hilbert(ctx);
+        }
+        gr_perf_end(ctx->perf, GR_PERF_PACK, 0);
+    }
+
+    gr_perf_begin(ctx->perf, GR_PERF_FORCES);
+    state->freeze_threshold = ctx->freeze_threshold;
+    state->samples = state->sampling ? ctx->repulsion_samples : 0;
+    state->verlet_cutoff = ctx->verlet_cutoff;
+    state->step = ctx->cur_iteration;
+    uint64_t pairs = 0;
+    if (state->kind == GR_RM_SGD) {
+        gr_step_sgd(ctx);
+        pairs = state->n_terms;
+    } else {
+        if (state->block_order != NULL) {
+            gr_order_blocks(ctx);
+        }
+        for (size_t b = 0; b < state->n_blocks; b += 1) {
+            state->blocks[b].symmetric = gr_block_symmetric(state, &state->blocks[b]);
+        }
+        state->kernel = gr_select_kernel(ctx);
+        if (state->partial_forces != NULL && state->blocks[0].symmetric) {
+            gr_pool_run(state->pool, gr_repulsion_task, ctx, state->n_threads);
+        }
+        gr_pool_run(state->pool, gr_step_block, ctx, state->n_blocks);
+        for (size_t b = 0; b < state->n_blocks; b += 1) {
+            const gr_Block *block = &state->blocks[b];
+            if (block->symmetric) {
+                pairs += (uint64_t)block->count * (block->count - 1) / 2;
+                continue;
+            }
+            if (state->verlet_counts != NULL) {
+                // a bit too many if some are frozen or pinned
+                for (size_t s = block->start; s < block->start + block->count; s += 1) {
+                    pairs += state->verlet_counts[s];
+                }
+                continue;
+            }
+            const size_t others = gr_block_sampled(state, block) ? state->samples : block->count;
+            pairs += (uint64_t)block->active * others;
+        }
+    }
+    if (ctx->method.kind == GR_RM_Fruchterman_and_Reingold) {
+        struct gr_RenderMethodFruchtgold *fag = &ctx->method.fruchtgold;
+        fag->cur_temp -= fag->decay;
+        if (fag->cur_temp < 0) {
+            fag->cur_temp = 0;
+        }
+    }
+    gr_perf_end(ctx->perf, GR_PERF_FORCES, pairs);
+
+    if (state->n_twin_classes > 0 || state->n_chains > 0 || state->n_leaf_groups > 0) {
+        gr_perf_begin(ctx->perf, GR_PERF_EXPAND);
+        gr_expand_twins(ctx);
+        gr_expand_chains(ctx);
+        gr_reinsert_leaves(ctx);
+        gr_perf_end(ctx->perf, GR_PERF_EXPAND, 0);
+    }
+
+    if (copied) {
+        gr_perf_begin(ctx->perf, GR_PERF_PACK);
+        if (state->offsets != NULL) {
+            gr_pack_blocks(ctx);
+        }
+        gr_scatter_positions(ctx);
+        gr_perf_end(ctx->perf, GR_PERF_PACK, 0);
+    } else if (ctx->output.base != NULL) {
+        gr_perf_begin(ctx->perf, GR_PERF_PACK);
+        for (size_t i = 0; i < ctx->graph->n_verticies; i += 1) {
+            gr_binding_set(&ctx->output, i, ctx->vertex_pos[i]);
+        }
+        gr_perf_end(ctx->perf, GR_PERF_PACK, 0);
+    }
+
+    ctx->bbox_min = gr_vec2(FLT_MAX, FLT_MAX);
+    ctx->bbox_max = gr_vec2(-FLT_MAX, -FLT_MAX);
+    for (size_t b = 0; b < state->n_blocks; b += 1) {
+        const gr_Block *block = &state->blocks[b];
+        const gr_Vec2 offset = state->offsets == NULL ? gr_vec2zero() : state->offsets[b];
+        gr_bbox_include(&ctx->bbox_min, &ctx->bbox_max,
+                        gr_vec2(block->min.x + offset.x, block->min.y + offset.y));
+        gr_bbox_include(&ctx->bbox_min, &ctx->bbox_max,
+                        gr_vec2(block->max.x + offset.x, block->max.y + offset.y));
+    }
+
+    ctx->cur_iteration += 1;
+    if (ctx->perf != NULL) {
+        ctx->perf->steps += 1;
+        const size_t threads = state->pool == NULL ? 1 : state->n_threads;
+        if (threads > ctx->perf->max_threads) {
+            ctx->perf->max_threads = threads;
+        }
+    }
+    gr_perf_end(ctx->perf, GR_PERF_STEP, pairs);
+
+    gr_arena_reset(ctx);
+    // Everything a step needs is reserved while doing the first one
+    assert(!reused || ctx->heap_allocs == heap_allocs);
+    (void)reused;
+    (void)heap_allocs;
+}
+
+void gr_render_step(gr_RenderContext *ctx)
+{
+    assert(ctx != NULL);
+    assert(ctx->graph != NULL);
+    gr_render_step_unchecked(ctx);
+}
+
+void gr_render_step_for(gr_RenderContext *ctx, const size_t iterations)
+{
+    assert(ctx != NULL);
+    assert(ctx->graph != NULL);
+    for (size_t i = 0; i < iterations; i += 1) {
+        gr_render_step_unchecked(ctx);
+    }
+}
+
+void gr_render_step_until(gr_RenderContext *ctx, const size_t target_iterations)
+{
+    assert(ctx != NULL);
+    assert(ctx->graph != NULL);
+    while (ctx->cur_iteration < target_iterations) {
+        gr_render_step_unchecked(ctx);
+    }
+}
+
+#ifndef GR_NO_THREADS
+#   define gr_atomic_load(p) atomic_load(p)
+#   define gr_atomic_store(p, v) atomic_store((p), (v))
+#   define gr_atomic_exchange(p, v) atomic_exchange((p), (v))
+#   define gr_atomic_fetch_add(p, v) atomic_fetch_add((p), (v))
+#   define gr_atomic_fetch_sub(p, v) atomic_fetch_sub((p), (v))
+#else
+#   define gr_atomic_load(p) (*(p))
+#   define gr_atomic_store(p, v) ((void)(*(p) = (v)))
+#   define gr_atomic_exchange(p, v) gr_exchange_uint((p), (v))
+#   define gr_atomic_fetch_add(p, v) ((void)(*(p) += (v)))
+#   define gr_atomic_fetch_sub(p, v) ((void)(*(p) -= (v)))
+
+static unsigned gr_exchange_uint(unsigned *p, const unsigned v)
+{
+    const unsigned old = *p;
+    *p = v;
+    return old;
+}
+#endif // GR_NO_THREADS
+
+// Set in `gr_AsyncLayout.middle` while it holds a step not acquired yet
+#define GR_ASYNC_FRESH 4u
+
+// Triple buffer: the layout thread writes a step into `back` (as the output
+// binding of the context) and swaps it with `middle`, `gr_async_acquire`
+// swaps a fresh `middle` with `front`. Neither side ever waits for the other.
+struct gr_AsyncLayout {
+    gr_RenderContext *ctx;
+    // output binding of the caller, restored by `gr_async_destroy`
+    gr_Binding output;
+    size_t target;
+    double interval;
+    double last_step;
+    gr_Vec2 *buffers;
+    gr_Snapshot slots[3];
+    unsigned front;
+    unsigned back;
+#ifndef GR_NO_THREADS
+    atomic_uint middle;
+    atomic_bool paused;
+    atomic_bool cancelled;
+    atomic_bool done;
+    atomic_size_t extra_steps;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+#else
+    unsigned middle;
+    bool paused;
+    bool cancelled;
+    bool done;
+    size_t extra_steps;
+#endif // GR_NO_THREADS
+};
+
+static double gr_now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void gr_async_bind_back(gr_AsyncLayout *async)
+{
+    async->ctx->output = gr_binding((void *)async->slots[async->back].vertex_pos,
+                                    sizeof(gr_Vec2), GR_BIND_FLOAT);
+}
+
+static void gr_async_publish(gr_AsyncLayout *async)
+{
+    const gr_RenderContext *ctx = async->ctx;
+    gr_Snapshot *slot = &async->slots[async->back];
+    slot->iteration = ctx->cur_iteration;
+    slot->bbox_min = ctx->bbox_min;
+    slot->bbox_max = ctx->bbox_max;
+    async->back = gr_atomic_exchange(&async->middle, async->back | GR_ASYNC_FRESH) & 3u;
+    gr_async_bind_back(async);
+}
+
+// Whether the next step may be done now. If only the interval has not passed
+// yet, `deadline` is set to the time it has.
+static bool gr_async_ready(gr_AsyncLayout *async, double *deadline)
+{
+    if (gr_atomic_load(&async->cancelled) || async->ctx->cur_iteration >= async->target) {
+        return false;
+    }
+    const double now = gr_now();
+    if (!gr_atomic_load(&async->paused)) {
+        if (now < async->last_step + async->interval) {
+            *deadline = async->last_step + async->interval;
+            return false;
+        }
+    } else if (gr_atomic_load(&async->extra_steps) > 0) {
+        // only taken here, so it cannot drop below zero
+        gr_atomic_fetch_sub(&async->extra_steps, 1);
+    } else {
+        return false;
+    }
+    async->last_step = now;
+    return true;
+}
+
+#ifndef GR_NO_THREADS
+// Blocks the layout thread until the next step may be done. Returns `false`
+// once the layout is over.
+static bool gr_async_wait(gr_AsyncLayout *async)
+{
+    bool step = false;
+    pthread_mutex_lock(&async->mutex);
+    while (!atomic_load(&async->cancelled) && async->ctx->cur_iteration < async->target) {
+        double deadline = 0;
+        if (gr_async_ready(async, &deadline)) {
+            step = true;
+            break;
+        }
+        if (deadline > 0) {
+            const struct timespec ts = {
+                .tv_sec = (time_t)deadline,
+                .tv_nsec = (long)((deadline - (double)(time_t)deadline) * 1e9),
+            };
+            pthread_cond_timedwait(&async->wake, &async->mutex, &ts);
+        } else {
+            pthread_cond_wait(&async->wake, &async->mutex);
+        }
+    }
+    pthread_mutex_unlock(&async->mutex);
+    return step;
+}
+
+static void *gr_async_worker(void *arg)
+{
+    gr_AsyncLayout *async = arg;
+    while (gr_async_wait(async)) {
+        gr_render_step_unchecked(async->ctx);
+        gr_async_publish(async);
+    }
+    atomic_store(&async->done, true);
+    return NULL;
+}
+
+// The flags are changed outside of the mutex, taking it before signaling
+// makes sure the layout thread is either waiting or sees the new value.
+static void gr_async_wake(gr_AsyncLayout *async)
+{
+    pthread_mutex_lock(&async->mutex);
+    pthread_cond_signal(&async->wake);
+    pthread_mutex_unlock(&async->mutex);
+}
+#else
+#   define gr_async_wake(async) ((void)(async))
+#endif // GR_NO_THREADS
+
+gr_AsyncLayout *gr_async_start_ex(gr_RenderContext *ctx, const size_t target_iterations,
+                                  const double interval, const bool paused)
+{
+    assert(ctx != NULL);
+    assert(ctx->graph != NULL);
+    assert(ctx->vertex_pos != NULL);
+    assert(interval >= 0);
+
+    const size_t n = ctx->graph->n_verticies;
+    gr_AsyncLayout *async = gr_ctx_calloc(ctx, 1, sizeof(*async));
+    if (async == NULL) {
+        return NULL;
+    }
+    async->buffers = gr_ctx_calloc(ctx, 3 * n + 1, sizeof(gr_Vec2));
+    if (async->buffers == NULL) {
+        gr_ctx_free(ctx, async);
+        return NULL;
+    }
+    async->ctx = ctx;
+    async->output = ctx->output;
+    async->target = target_iterations;
+    async->interval = interval;
+    async->last_step = -interval;
+    for (size_t s = 0; s < 3; s += 1) {
+        async->slots[s] = (gr_Snapshot) {
+            .vertex_pos = async->buffers + s * n,
+            .n_verticies = n,
+            .iteration = ctx->cur_iteration,
+            .bbox_min = ctx->bbox_min,
+            .bbox_max = ctx->bbox_max,
+        };
+    }
+    memcpy(async->buffers, ctx->vertex_pos, n * sizeof(gr_Vec2));
+    async->front = 0;
+    async->back = 2;
+    gr_async_bind_back(async);
+#ifndef GR_NO_THREADS
+    atomic_init(&async->middle, 1);
+    atomic_init(&async->paused, paused);
+    atomic_init(&async->cancelled, false);
+    atomic_init(&async->done, false);
+    atomic_init(&async->extra_steps, 0);
+    pthread_mutex_init(&async->mutex, NULL);
+    pthread_cond_init(&async->wake, NULL);
+    if (pthread_create(&async->thread, NULL, gr_async_worker, async) != 0) {
+        pthread_mutex_destroy(&async->mutex);
+        pthread_cond_destroy(&async->wake);
+        ctx->output = async->output;
+        gr_ctx_free(ctx, async->buffers);
+        gr_ctx_free(ctx, async);
+        return NULL;
+    }
+#else
+    async->middle = 1;
+    async->paused = paused;
+#endif // GR_NO_THREADS
+    return async;
+}
+
+const gr_Snapshot *gr_async_acquire(gr_AsyncLayout *async)
+{
+    assert(async != NULL);
+#ifdef GR_NO_THREADS
+    double deadline = 0;
+    if (gr_async_ready(async, &deadline)) {
+        gr_render_step_unchecked(async->ctx);
+        gr_async_publish(async);
+    }
+#endif // GR_NO_THREADS
+    if (gr_atomic_load(&async->middle) & GR_ASYNC_FRESH) {
+        async->front = gr_atomic_exchange(&async->middle, async->front) & 3u;
+    }
+    return &async->slots[async->front];
+}
+
+void gr_async_pause(gr_AsyncLayout *async)
+{
+    assert(async != NULL);
+    gr_atomic_store(&async->paused, true);
+}
+
+void gr_async_resume(gr_AsyncLayout *async)
+{
+    assert(async != NULL);
+    gr_atomic_store(&async->extra_steps, 0);
+    gr_atomic_store(&async->paused, false);
+    gr_async_wake(async);
+}
+
+void gr_async_step(gr_AsyncLayout *async)
+{
+    assert(async != NULL);
+    gr_atomic_fetch_add(&async->extra_steps, 1);
+    gr_async_wake(async);
+}
+
+void gr_async_cancel(gr_AsyncLayout *async)
+{
+    assert(async != NULL);
+    gr_atomic_store(&async->cancelled, true);
+    gr_async_wake(async);
+}
+
+bool gr_async_done(gr_AsyncLayout *async)
+{
+    assert(async != NULL);
+#ifndef GR_NO_THREADS
+    return atomic_load(&async->done);
+#else
+    return async->cancelled || async->ctx->cur_iteration >= async->target;
+#endif // GR_NO_THREADS
+}
+
+void gr_async_destroy(gr_AsyncLayout *async)
+{
+    assert(async != NULL);
+    gr_RenderContext *ctx = async->ctx;
+    gr_atomic_store(&async->paused, false);
+#ifndef GR_NO_THREADS
+    gr_async_wake(async);
+    pthread_join(async->thread, NULL);
+    pthread_mutex_destroy(&async->mutex);
+    pthread_cond_destroy(&async->wake);
+#else
+    gr_render_step_until(ctx, async->cancelled ? 0 : async->target);
+#endif // GR_NO_THREADS
+    ctx->output = async->output;
+    gr_ctx_free(ctx, async->buffers);
+    gr_ctx_free(ctx, async);
+}
+
+void gr_snapshot_normalize_bound_ex(const gr_Snapshot *snapshot, const gr_Vec2 mins,
+                                    const gr_Vec2 maxs, const gr_Binding out)
+{
+    assert(snapshot != NULL);
+    gr_normalize_bound(snapshot->vertex_pos, snapshot->n_verticies, snapshot->bbox_min,
+                       snapshot->bbox_max, mins, maxs, &out);
+}
+
+gr_SmallContext gr_small_ctx_create_ex(const size_t n_verticies,
+                                       const gr_RenderMethod method,
+                                       const bool init_positions)
+{
+    assert(n_verticies > 0 && n_verticies <= GR_SMALL_MAX);
+    assert(method.kind == GR_RM_Eades || method.kind == GR_RM_Fruchterman_and_Reingold);
+    gr_SmallContext ctx = {
+        .method = method,
+        .n_verticies = n_verticies,
+        // edges and positions are zeroed
+        .cur_iteration = 0,
+        .bbox_min = gr_vec2(FLT_MAX, FLT_MAX),
+        .bbox_max = gr_vec2(-FLT_MAX, -FLT_MAX),
+        .fast_math = false,
+    };
+    for (size_t i = 0; i < n_verticies && init_positions; i += 1) {
+        ctx.vertex_pos[i] = (gr_Vec2) {
+            .x = gr_randf(0, 1),
+            .y = gr_randf(0, 1),
+        };
+        gr_bbox_include(&ctx.bbox_min, &ctx.bbox_max, ctx.vertex_pos[i]);
+    }
+    return ctx;
+}
+
+bool gr_small_add_edge(gr_SmallContext *ctx, const gr_Edge edge)
+{
+    assert(ctx != NULL);
+    if (edge.start >= ctx->n_verticies || edge.end >= ctx->n_verticies) {
+        return false;
+    }
+    ctx->edges[edge.start] |= (uint64_t)1 << edge.end;
+    if (!edge.directed) {
+        ctx->edges[edge.end] |= (uint64_t)1 << edge.start;
+    }
+    return true;
+}
+
+void gr_small_normalize_into_ex(const gr_SmallContext *ctx, const gr_Vec2 mins,
+                                const gr_Vec2 maxs, gr_Vec2 *out)
+{
+    assert(ctx != NULL);
+    assert(out != NULL);
+    assert(mins.x < maxs.x && mins.y < maxs.y);
+
+    gr_Vec2 min = ctx->bbox_min;
+    gr_Vec2 max = ctx->bbox_max;
+    if (min.x > max.x) {
+        for (size_t i = 0; i < ctx->n_verticies; i += 1) {
+            gr_bbox_include(&min, &max, ctx->vertex_pos[i]);
+        }
+    }
+
+    for (size_t i = 0; i < ctx->n_verticies; i += 1) {
+        const gr_Vec2 p = ctx->vertex_pos[i];
+        out[i].x = gr_lerpf(p.x, min.x, max.x, mins.x, maxs.x);
+        out[i].y = gr_lerpf(p.y, min.y, max.y, mins.y, maxs.y);
+    }
+}
+
+// Repulsion of `n` by all verticies like `gr_repel_exact`, `n` itself adds
+// nothing as its direction is zero
+GR_TEMPLATE gr_Vec2 gr_small_repel(const enum gr_RenderMethodKind kind, const float c,
+                                   const gr_SmallContext *ctx, const size_t n,
+                                   const bool fast)
+{
+    const gr_Vec2 *pos = ctx->vertex_pos;
+    const gr_Vec2 p = pos[n];
+    gr_Vec2 force = gr_vec2zero();
+    size_t i = 0;
+    if (fast) {
+        float lane_x[GR_LANES] = { 0 };
+        float lane_y[GR_LANES] = { 0 };
+        for (; i + GR_LANES <= ctx->n_verticies; i += GR_LANES) {
+            for (size_t l = 0; l < GR_LANES; l += 1) {
+                const float d_x = pos[i + l].x - p.x;
+                const float d_y = pos[i + l].y - p.y;
+                const gr_Vec2 f = kind == GR_RM_Eades ? gr_pair_eades(c, d_x, d_y, 1, true)
+                                                      : gr_pair_fruchtgold(c, d_x, d_y, 1, true);
+                lane_x[l] += f.x;
+                lane_y[l] += f.y;
+            }
+        }
+        for (size_t l = 0; l < GR_LANES; l += 1) {
+            force.x += lane_x[l];
+            force.y += lane_y[l];
+        }
+    }
+    for (; i < ctx->n_verticies; i += 1) {
+        const float d_x = pos[i].x - p.x;
+        const float d_y = pos[i].y - p.y;
+        const gr_Vec2 f = kind == GR_RM_Eades ? gr_pair_eades(c, d_x, d_y, 1, fast)
+                                              : gr_pair_fruchtgold(c, d_x, d_y, 1, fast);
+        force.x += f.x;
+        force.y += f.y;
+    }
+    return force;
+}
+
+// Index of the lowest set bit of `bits`, which must not be zero
+static size_t gr_lowest_bit(const uint64_t bits)
+{
+#ifdef __GNUC__
+    return (size_t)__builtin_ctzll(bits);
+#else
+    size_t i = 0;
+    while (((bits >> i) & 1) == 0) {
+        i += 1;
+    }
+    return i;
+#endif // __GNUC__
+}
+
+// Same forces as `gr_step_method_eades` and `gr_step_method_fruchtman_and_reingold`:
+// repulsion by all verticies, taken back along the edges of `n` which
+// attract it instead, moving one vertex after the other
+GR_TEMPLATE void gr_small_kernel(gr_SmallContext *ctx, const enum gr_RenderMethodKind kind,
+                                 const bool fast)
+{
+    const struct gr_RenderMethodEades *eades = &ctx->method.eades;
+    const struct gr_RenderMethodFruchtgold *fag = &ctx->method.fruchtgold;
+    const size_t count = ctx->n_verticies;
+    gr_Vec2 *pos = ctx->vertex_pos;
+    const float k = kind == GR_RM_Eades ? 0 : fag->c * sqrtf(fag->area / count);
+    const gr_Vec2 grav_cen = kind == GR_RM_Eades ? eades->grav_cen : fag->grav_cen;
+    ctx->bbox_min = gr_vec2(FLT_MAX, FLT_MAX);
+    ctx->bbox_max = gr_vec2(-FLT_MAX, -FLT_MAX);
+    for (size_t n = 0; n < count; n += 1) {
+        // self loops neither attract nor repel
+        const uint64_t edges = ctx->edges[n] & ~((uint64_t)1 << n);
+        gr_Vec2 force = kind == GR_RM_Eades ? gr_small_repel(kind, eades->c3, ctx, n, fast)
+                                            : gr_small_repel(kind, k, ctx, n, fast);
+        for (uint64_t bits = edges; bits != 0; bits &= bits - 1) {
+            const size_t i   = gr_lowest_bit(bits);
+            const float d_x  = pos[i].x - pos[n].x;
+            const float d_y  = pos[i].y - pos[n].y;
+            const float d_sq = gr_sq(d_x) + gr_sq(d_y);
+            const float inv_d = gr_frsqrt(d_sq, fast);
+            const float d    = gr_fdist(d_sq, inv_d, fast);
+            const float f    = kind == GR_RM_Eades
+                ? eades->c1 * gr_flog(gr_fdiv(d, eades->c2, fast), fast) +
+                  gr_fdiv_d_sq(eades->c3, d, inv_d, fast)
+                : gr_fdiv(d_sq, k, fast) + gr_fdiv_d(gr_sq(k), d, inv_d, fast);
+            force.x += f * gr_fdiv_d(d_x, d, inv_d, fast);
+            force.y += f * gr_fdiv_d(d_y, d, inv_d, fast);
+        }
+        const float g_x  = grav_cen.x - pos[n].x;
+        const float g_y  = grav_cen.y - pos[n].y;
+        const float g_sq = gr_sq(g_x) + gr_sq(g_y);
+        const float g_d  = gr_not0f(sqrtf(g_sq));
+        const float g    = kind == GR_RM_Eades ? eades->c1 * logf(g_d / eades->c2) : g_sq / k;
+        force.x += g * (g_x / g_d);
+        force.y += g * (g_y / g_d);
+
+        const float scale = kind == GR_RM_Eades ? eades->c4 : fag->cur_temp;
+        pos[n].x += scale * force.x;
+        pos[n].y += scale * force.y;
+        gr_bbox_include(&ctx->bbox_min, &ctx->bbox_max, pos[n]);
+    }
+}
+
+void gr_small_step(gr_SmallContext *ctx)
+{
+    assert(ctx != NULL);
+    if (ctx->method.kind == GR_RM_Eades) {
+        if (ctx->fast_math) {
+            gr_small_kernel(ctx, GR_RM_Eades, true);
+        } else {
+            gr_small_kernel(ctx, GR_RM_Eades, false);
+        }
+    } else {
+        assert(ctx->method.kind == GR_RM_Fruchterman_and_Reingold);
+        if (ctx->fast_math) {
+            gr_small_kernel(ctx, GR_RM_Fruchterman_and_Reingold, true);
+        } else {
+            gr_small_kernel(ctx, GR_RM_Fruchterman_and_Reingold, false);
+        }
+        struct gr_RenderMethodFruchtgold *fag = &ctx->method.fruchtgold;
+        fag->cur_temp -= fag->decay;
+        if (fag->cur_temp < 0) {
+            fag->cur_temp = 0;
+        }
+    }
+    ctx->cur_iteration += 1;
+}
+
+void gr_small_step_for(gr_SmallContext *ctx, const size_t iterations)
+{
+    for (size_t i = 0; i < iterations; i += 1) {
+        gr_small_step(ctx);
+    }
+}
+
+void gr_small_step_until(gr_SmallContext *ctx, const size_t target_iterations)
+{
+    assert(ctx != NULL);
+    while (ctx->cur_iteration < target_iterations) {
+        gr_small_step(ctx);
+    }
+}
+
+// Product of the shifted Laplacian `c * I - L` and `in` for the rows
+// `[task * chunk, (task + 1) * chunk)`
+typedef struct {
+    const gr_Adjacency *adj;
+    // Weight of every adjacency entry, `NULL` if all are 1
+    const double *weights;
+    // `c` minus the weighted degree of every vertex
+    const double *diag;
+    const double *in;
+    double *out;
+    size_t n;
+    size_t chunk;
+} gr_SpMV;
+
+static void gr_spmv_task(void *arg, size_t task, size_t thread)
+{
+    const gr_SpMV *mv = arg;
+    const size_t start = task * mv->chunk;
+    const size_t end = start + mv->chunk < mv->n ? start + mv->chunk : mv->n;
+    (void)thread;
+    for (size_t v = start; v < end; v += 1) {
+        double sum = mv->diag[v] * mv->in[v];
+        for (size_t e = mv->adj->offsets[v]; e < mv->adj->offsets[v + 1]; e += 1) {
+            const double w = mv->weights == NULL ? 1 : mv->weights[e];
+            sum += w * mv->in[mv->adj->neighbors[e]];
+        }
+        mv->out[v] = sum;
+    }
+}
+
+static double gr_dot(const double *a, const double *b, const size_t n)
+{
+    double sum = 0;
+    for (size_t i = 0; i < n; i += 1) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+// Removes the mean of every component from `x`, which projects out the
+// eigenvectors of eigenvalue 0 (the indicators of the components)
+static void gr_project_components(double *x, const size_t n, const size_t *comp,
+                                  const size_t *comp_size, double *comp_sum)
+{
+    for (size_t v = 0; v < n; v += 1) {
+        comp_sum[comp[v]] = 0;
+    }
+    for (size_t v = 0; v < n; v += 1) {
+        comp_sum[comp[v]] += x[v];
+    }
+    for (size_t v = 0; v < n; v += 1) {
+        x[v] -= comp_sum[comp[v]] / comp_size[comp[v]];
+    }
+}
+
+// Removes the first `n_axes` (orthonormal) axes from `x`
+static void gr_project_axes(double *x, const size_t n, double *const *axes,
+                            const size_t n_axes)
+{
+    for (size_t a = 0; a < n_axes; a += 1) {
+        const double h = gr_dot(x, axes[a], n);
+        for (size_t v = 0; v < n; v += 1) {
+            x[v] -= h * axes[a][v];
+        }
+    }
+}
+
+// Implicit QL iterations on the symmetric tridiagonal matrix with diagonal
+// `d` and off-diagonal `e` (`e[i]` couples `i` and `i + 1`, `e[m - 1]` is
+// scratch). Afterwards `d` holds the eigenvalues and column `i` of the row
+// major `m * m` matrix `z` (starting as the identity) the eigenvector of `d[i]`.
+static void gr_tridiagonal_eigen(const size_t m, double *d, double *e, double *z)
+{
+    for (size_t l = 0; l < m; l += 1) {
+        size_t iter = 0;
+        size_t mm;
+        do {
+            for (mm = l; mm + 1 < m; mm += 1) {
+                const double dd = fabs(d[mm]) + fabs(d[mm + 1]);
+                if (fabs(e[mm]) <= DBL_EPSILON * dd) {
+                    break;
+                }
+            }
+            if (mm == l || iter++ == 60) {
+                break;
+            }
+            double g = (d[l + 1] - d[l]) / (2 * e[l]);
+            double r = hypot(g, 1);
+            g = d[mm] - d[l] + e[l] / (g + (g >= 0 ? r : -r));
+            double s = 1;
+            double c = 1;
+            double p = 0;
+            bool underflow = false;
+            for (size_t i = mm; i-- > l;) {
+                double f = s * e[i];
+                const double b = c * e[i];
+                r = hypot(f, g);
+                e[i + 1] = r;
+                if (r == 0) {
+                    d[i + 1] -= p;
+                    e[mm] = 0;
+                    underflow = true;
+                    break;
+                }
+                s = f / r;
+                c = g / r;
+                g = d[i + 1] - p;
+                r = (d[i] - g) * s + 2 * c * b;
+                p = s * r;
+                d[i + 1] = g + p;
+                g = c * r - b;
+                for (size_t k = 0; k < m; k += 1) {
+                    f = z[k * m + i + 1];
+                    z[k * m + i + 1] = s * z[k * m + i] + c * f;
+                    z[k * m + i] = c * z[k * m + i] - s * f;
+                }
+            }
+            if (!underflow) {
+                d[l] -= p;
+                e[l] = g;
+                e[mm] = 0;
+            }
+        } while (true);
+    }
+}
+
+// The eigenvectors of the smallest eigenvalues of `L` are the ones of the
+// largest of `c * I - L`, with `c` bounding the spectrum of `L`. Those are
+// found by the Lanczos method with full reorthogonalization, after projecting
+// out the trivial ones.
+void gr_render_ctx_spectral(gr_RenderContext *ctx)
+{
+    assert(ctx != NULL);
+    assert(ctx->graph != NULL);
+    assert(ctx->vertex_pos != NULL);
+    // only for the thread pool
+    gr_render_prepare(ctx);
+    const gr_Graph *graph = ctx->graph;
+    const size_t n = graph->n_verticies;
+    const gr_Adjacency adj = gr_graph_adjacency(ctx);
+
+    size_t *comp = gr_arena_alloc(ctx, n * sizeof(size_t));
+    size_t *comp_size = gr_arena_alloc(ctx, n * sizeof(size_t));
+    double *comp_sum = gr_arena_alloc(ctx, n * sizeof(double));
+    memset(comp_size, 0, n * sizeof(size_t));
+    size_t n_comps = 0;
+    for (size_t v = 0; v < n; v += 1) {
+        comp[v] = gr_graph_component(graph, v);
+        n_comps += comp_size[comp[v]] == 0;
+        comp_size[comp[v]] += 1;
+    }
+
+    double *weights = NULL;
+    if (adj.lengths != NULL) {
+        // stronger springs for shorter edges
+        weights = gr_arena_alloc(ctx, adj.offsets[n] * sizeof(double) + 1);
+        for (size_t e = 0; e < adj.offsets[n]; e += 1) {
+            weights[e] = 1.0 / adj.lengths[e];
+        }
+    }
+    double *diag = gr_arena_alloc(ctx, n * sizeof(double));
+    double c = 0;
+    for (size_t v = 0; v < n; v += 1) {
+        diag[v] = 0;
+        for (size_t e = adj.offsets[v]; e < adj.offsets[v + 1]; e += 1) {
+            diag[v] += weights == NULL ? 1 : weights[e];
+        }
+        if (2 * diag[v] > c) {
+            c = 2 * diag[v];
+        }
+    }
+    for (size_t v = 0; v < n; v += 1) {
+        diag[v] = c - diag[v];
+    }
+
+    const size_t dim = n - n_comps;
+    const size_t m = dim < GR_SPECTRAL_STEPS ? dim : GR_SPECTRAL_STEPS;
+    double *basis = gr_ctx_calloc_or_die(ctx, (m + 1) * n, sizeof(double));
+    double *alpha = gr_ctx_calloc_or_die(ctx, m + 1, sizeof(double));
+    double *beta = gr_ctx_calloc_or_die(ctx, m + 1, sizeof(double));
+    double *z = gr_ctx_calloc_or_die(ctx, m * m + 1, sizeof(double));
+    double *coords[2] = {
+        gr_ctx_calloc_or_die(ctx, n, sizeof(double)),
+        gr_ctx_calloc_or_die(ctx, n, sizeof(double)),
+    };
+
+    uint64_t seed = 0x9e3779b97f4a7c15ull;
+    const size_t n_tasks = ctx->state->pool == NULL ? 1 : 4 * ctx->state->n_threads;
+    // One axis after the other, the second one orthogonal to the first. A
+    // single Krylov space only holds one vector of every eigenspace, so this
+    // also finds both of an eigenvalue of multiplicity two (like the ones of
+    // square grids).
+    for (size_t axis = 0; axis < 2 && axis < dim; axis += 1) {
+        const size_t steps_max = m < dim - axis ? m : dim - axis;
+        for (size_t v = 0; v < n; v += 1) {
+            basis[v] = (double)(gr_xorshift(&seed) >> 11) / (double)(1ull << 53) - 0.5;
+        }
+        for (size_t restart = 0; restart < GR_SPECTRAL_RESTARTS; restart += 1) {
+            gr_project_components(basis, n, comp, comp_size, comp_sum);
+            gr_project_axes(basis, n, coords, axis);
+            const double norm = sqrt(gr_dot(basis, basis, n));
+            for (size_t v = 0; v < n; v += 1) {
+                basis[v] /= norm;
+            }
+
+            size_t steps = 0;
+            for (size_t j = 0; j < steps_max; j += 1) {
+                const double *v_j = &basis[j * n];
+                double *w = &basis[(j + 1) * n];
+                gr_SpMV mv = {
+                    .adj = &adj,
+                    .weights = weights,
+                    .diag = diag,
+                    .in = v_j,
+                    .out = w,
+                    .n = n,
+                    .chunk = (n + n_tasks - 1) / n_tasks,
+                };
+                gr_pool_run(ctx->state->pool, gr_spmv_task, &mv, n_tasks);
+                gr_project_components(w, n, comp, comp_size, comp_sum);
+                gr_project_axes(w, n, coords, axis);
+
+                alpha[j] = gr_dot(w, v_j, n);
+                for (size_t v = 0; v < n; v += 1) {
+                    w[v] -= alpha[j] * v_j[v] + (j > 0 ? beta[j - 1] * basis[(j - 1) * n + v] : 0);
+                }
+                for (size_t k = 0; k <= j; k += 1) {
+                    const double *v_k = &basis[k * n];
+                    const double h = gr_dot(w, v_k, n);
+                    for (size_t v = 0; v < n; v += 1) {
+                        w[v] -= h * v_k[v];
+                    }
+                }
+                beta[j] = sqrt(gr_dot(w, w, n));
+                steps = j + 1;
+                if (beta[j] <= GR_SPECTRAL_TOLERANCE * c) {
+                    // the Krylov space is invariant, its eigenvectors are exact
+                    break;
+                }
+                for (size_t v = 0; v < n; v += 1) {
+                    w[v] /= beta[j];
+                }
+            }
+
+            memset(z, 0, steps * steps * sizeof(double));
+            for (size_t i = 0; i < steps; i += 1) {
+                z[i * steps + i] = 1;
+            }
+            const double residual = beta[steps - 1];
+            gr_tridiagonal_eigen(steps, alpha, beta, z);
+            size_t best = 0;
+            for (size_t i = 1; i < steps; i += 1) {
+                if (alpha[i] > alpha[best]) {
+                    best = i;
+                }
+            }
+            memset(coords[axis], 0, n * sizeof(double));
+            for (size_t k = 0; k < steps; k += 1) {
+                const double y = z[k * steps + best];
+                for (size_t v = 0; v < n; v += 1) {
+                    coords[axis][v] += y * basis[k * n + v];
+                }
+            }
+            // the residual of a Ritz vector is the last entry of its
+            // eigenvector in `T` times the last off-diagonal
+            const double y_last = z[(steps - 1) * steps + best];
+            if (fabs(residual * y_last) <= GR_SPECTRAL_TOLERANCE * c) {
+                break;
+            }
+            // restart from the best guess
+            memcpy(basis, coords[axis], n * sizeof(double));
+        }
+    }
+
+    // scale the mean edge to the ideal length of the render method
+    double length = 0;
+    for (size_t v = 0; v < n; v += 1) {
+        for (size_t e = adj.offsets[v]; e < adj.offsets[v + 1]; e += 1) {
+            const size_t u = adj.neighbors[e];
+            length += hypot(coords[0][v] - coords[0][u], coords[1][v] - coords[1][u]);
+        }
+    }
+    length = adj.offsets[n] == 0 ? 0 : length / adj.offsets[n];
+    const double ideal = gr_method_edge_length(&ctx->method, n);
+    const double scale = length > 0 ? ideal / length : 1;
+    const gr_Vec2 grav_cen = gr_method_grav_cen(&ctx->method);
+    for (size_t v = 0; v < n; v += 1) {
+        if (gr_is_pinned(ctx->pinned, v)) {
+            continue;
+        }
+        const double jitter_x = (double)(gr_xorshift(&seed) >> 11) / (double)(1ull << 53) - 0.5;
+        const double jitter_y = (double)(gr_xorshift(&seed) >> 11) / (double)(1ull << 53) - 0.5;
+        ctx->vertex_pos[v] = gr_vec2(
+            grav_cen.x + scale * coords[0][v] + GR_SPECTRAL_JITTER * ideal * jitter_x,
+            grav_cen.y + scale * coords[1][v] + GR_SPECTRAL_JITTER * ideal * jitter_y);
+    }
+
+    gr_ctx_free(ctx, basis);
+    gr_ctx_free(ctx, alpha);
+    gr_ctx_free(ctx, beta);
+    gr_ctx_free(ctx, z);
+    gr_ctx_free(ctx, coords[0]);
+    gr_ctx_free(ctx, coords[1]);
+    gr_arena_reset(ctx);
+    gr_render_ctx_update_bbox(ctx);
+}
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#    endif // GRAY_IMPLEMENTATION
+#endif // _GRAY_ALREADY_IMPLEMENTED_
@@ -1,4 +1,3 @@
-#include <string.h>
 #include <raylib.h>
 #include <time.h>
 
@@ -11,6 +10,7 @@
 // Some random positions will lead to a lot of necessary iterations, others are
 // done after a few dozens of iterations.
 #define TARGET_ITERATION 200
+// seconds between two steps of the layout thread
 #define TIMER 0.1
 #define BG LIGHTGRAY
 
@@ -44,67 +44,56 @@ int main() {
         graph_add_edge(&g, edges[i]);
     }
     RenderContext ctx = render_ctx_create(&g);
-    Vec2 *backup = malloc(g.n_verticies * sizeof(Vec2));
-    memcpy(backup, ctx.vertex_pos, g.n_verticies * sizeof(Vec2));
+    // The layout runs on its own thread, every frame draws the latest step it
+    // finished, so drawing never waits for it.
+    AsyncLayout *layout = async_start_ex(&ctx, TARGET_ITERATION, TIMER, true);
+    if (layout == NULL) {
+        TraceLog(LOG_ERROR, "Could not start the layout thread\n");
+        return 1;
+    }
+    // screen positions which are drawn, the context keeps its own ones
+    Vector2 *view = malloc(g.n_verticies * sizeof(Vector2));
 
     bool show_id = false;
-    bool step = false;
     bool run_till_end = false;
-    float timer = 0;
 
     while (!WindowShouldClose()) {
-        const float dt = GetFrameTime();
-    
-        if (ctx.cur_iteration < TARGET_ITERATION) {
-            if (IsKeyPressed(KEY_SPACE)) {
+        const bool done = async_done(layout);
+        if (!done) {
+            if (IsKeyPressed(KEY_SPACE) && !run_till_end) {
                 run_till_end = true;
+                async_resume(layout);
             }
-            step |= IsKeyPressed(KEY_S) || run_till_end;
-
-            if (step) {
-                timer += dt;
-                for (bool first = true; timer > TIMER; timer -= TIMER) {
-                    if (first) {
-                        memcpy(ctx.vertex_pos, backup, g.n_verticies * sizeof(Vec2));
-                        first = false;
-                    }
-                    render_step(&ctx);
-                    step = false;
-                }
-
-                if (!step) {
-                    memcpy(backup, ctx.vertex_pos, g.n_verticies * sizeof(Vec2));
-                    render_ctx_normalize(&ctx);
-                }
+            if (IsKeyPressed(KEY_S) && !run_till_end) {
+                async_step(layout);
             }
         }
         if (IsKeyPressed(KEY_N)) {
             show_id = !show_id;
         }
 
+        const int w = GetRenderWidth();
+        const int h = GetRenderHeight();
+        const Snapshot *snapshot = async_acquire(layout);
+        snapshot_normalize_bound_ex(snapshot, vec2(0.05 * w, 0.05 * h),
+                                    vec2(0.95 * w, 0.95 * h),
+                                    binding(view, sizeof(Vector2), BIND_FLOAT));
+
         BeginDrawing();
             ClearBackground(BG);
 
-            const int w = GetRenderWidth();
-            const int h = GetRenderHeight();
-
             // draw edges
             for (size_t n = 0; n < ctx.graph->n_verticies; n += 1) {
                 for (size_t i = 0; i < ctx.graph->n_verticies; i += 1) {
                     if (ctx.graph->edges[n][i]) {
-                        DrawLine(ctx.vertex_pos[n].x * w, ctx.vertex_pos[n].y * h,
-                                 ctx.vertex_pos[i].x * w, ctx.vertex_pos[i].y * h,
-                                 EDGE_COLOR);
+                        DrawLineV(view[n], view[i], EDGE_COLOR);
                     }
                 }
             }
 
             // draw verticies
             for (size_t i = 0; i < ctx.graph->n_verticies; i += 1) {
-                Vector2 pos = {
-                    .x = ctx.vertex_pos[i].x * w,
-                    .y = ctx.vertex_pos[i].y * h,
-                };
+                const Vector2 pos = view[i];
                 if (show_id) {
                     DrawCircleV(pos, VERTEX_RAD + 2, VERTEX_COLOR);
                     DrawCircleV(pos, VERTEX_RAD, BG);
@@ -116,8 +105,8 @@ int main() {
                 }
             }
 
-            if (ctx.cur_iteration < TARGET_ITERATION) {
-                DrawText(TextFormat("Itation %zu of %zu", ctx.cur_iteration,
+            if (!done) {
+                DrawText(TextFormat("Itation %zu of %zu", snapshot->iteration,
                                     TARGET_ITERATION), TXT_ARGS(0));
                 DrawText(TextFormat("<N>: to show vertex ids (%s)",
                                     show_id ? "true" : "false"), TXT_ARGS(1));
@@ -131,7 +120,9 @@ int main() {
         EndDrawing();
     }
 
-    free(backup);
+    free(view);
+    async_cancel(layout);
+    async_destroy(layout);
     render_ctx_destroy(&ctx);
     graph_destroy(&g);
 
@@ -6,18 +6,28 @@ extern "C" {
 #endif // __cplusplus
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 
 #ifndef GR_REQUIRE_PREFIX
+#   define Index gr_Index
 #   define Vec2 gr_Vec2
 #       define vec2 gr_vec2
 #       define vec2zero gr_vec2zero
 #       define vec2one gr_vec2one
+#   define Allocator gr_Allocator
+#       define allocator_default gr_allocator_default
+#   define Arena gr_Arena
+#   define bitmap_words gr_bitmap_words
+#   define bitmap_get gr_bitmap_get
+#   define bitmap_set gr_bitmap_set
+#   define bitmap_clear gr_bitmap_clear
 #   define Graph gr_Graph
 #       define Edge gr_Edge
 #       define edge_u gr_edge_u
 #       define edge_d gr_edge_d
+#       define EdgeLength gr_EdgeLength
 #   define RenderMethodKind gr_RenderMethodKind
 #   define RenderMethod gr_RenderMethod
 #       define RM_Eades GR_RM_Eades
@@ -25,20 +35,75 @@ extern "C" {
 #       define RM_SPRING_1 GR_RM_SPRING_1
 #       define RM_SPRING_2 GR_RM_SPRING_2
 #   define RenderContext gr_RenderContext
+#   define Binding gr_Binding
+#       define binding gr_binding
+#   define BindType gr_BindType
+#       define BIND_FLOAT GR_BIND_FLOAT
+#       define BIND_DOUBLE GR_BIND_DOUBLE
+#   define InitPositions gr_InitPositions
+#       define INIT_NONE GR_INIT_NONE
+#       define INIT_RANDOM GR_INIT_RANDOM
+#       define INIT_SPECTRAL GR_INIT_SPECTRAL
+#   define VertexOrder gr_VertexOrder
+#       define ORDER_NONE GR_ORDER_NONE
+#       define ORDER_RCM GR_ORDER_RCM
+#       define ORDER_HILBERT GR_ORDER_HILBERT
+#   define graph_init_ex gr_graph_init_ex
 #   define graph_init gr_graph_init
 #   define graph_destroy gr_graph_destroy
+#   define graph_add_edge_ex gr_graph_add_edge_ex
 #   define graph_add_edge gr_graph_add_edge
 #   define graph_add_edges gr_graph_add_edges
 
+#   define render_ctx_create_alloc gr_render_ctx_create_alloc
 #   define render_ctx_create_ex gr_render_ctx_create_ex
 #   define render_ctx_create gr_render_ctx_create
 #   define render_ctx_destroy gr_render_ctx_destroy
+#   define render_ctx_spectral gr_render_ctx_spectral
 #   define render_ctx_normalize_ex gr_render_ctx_normalize_ex
 #   define render_ctx_normalize gr_render_ctx_normalize
+#   define render_ctx_normalize_into_ex gr_render_ctx_normalize_into_ex
+#   define render_ctx_normalize_into gr_render_ctx_normalize_into
+#   define render_ctx_normalize_bound_ex gr_render_ctx_normalize_bound_ex
+#   define render_ctx_normalize_bound gr_render_ctx_normalize_bound
+#   define render_ctx_update_bbox gr_render_ctx_update_bbox
 #   define render_step gr_render_step
 #   define render_step_for gr_render_step_for
 #   define render_step_until gr_render_step_until
 #   define render_run gr_render_run
+
+#   define SmallContext gr_SmallContext
+#   define small_ctx_create_ex gr_small_ctx_create_ex
+#   define small_ctx_create gr_small_ctx_create
+#   define small_add_edge gr_small_add_edge
+#   define small_normalize_into_ex gr_small_normalize_into_ex
+#   define small_normalize_into gr_small_normalize_into
+#   define small_step gr_small_step
+#   define small_step_for gr_small_step_for
+#   define small_step_until gr_small_step_until
+#   define small_run gr_small_run
+
+#   define Snapshot gr_Snapshot
+#   define AsyncLayout gr_AsyncLayout
+#   define async_start_ex gr_async_start_ex
+#   define async_start gr_async_start
+#   define async_acquire gr_async_acquire
+#   define async_pause gr_async_pause
+#   define async_resume gr_async_resume
+#   define async_step gr_async_step
+#   define async_cancel gr_async_cancel
+#   define async_done gr_async_done
+#   define async_destroy gr_async_destroy
+#   define snapshot_normalize_bound_ex gr_snapshot_normalize_bound_ex
+#   define snapshot_normalize_bound gr_snapshot_normalize_bound
+
+#   define Perf gr_Perf
+#   define PerfPhase gr_PerfPhase
+#   define PerfCounter gr_PerfCounter
+#   define perf_init gr_perf_init
+#   define perf_destroy gr_perf_destroy
+#   define perf_reset gr_perf_reset
+#   define perf_report gr_perf_report
 #endif // GR_REQUIRE_PREFIX
 
 #ifndef GR_DEFAULT_METHOD
@@ -49,6 +114,51 @@ extern "C" {
 #   define GR_DEFAULT_ITERATIONS 100
 #endif // GR_DEFAULT_ITERATIONS
 
+// Number of consecutive steps a vertex has to stay below
+// `gr_RenderContext.freeze_threshold` before it is frozen
+#ifndef GR_FREEZE_STEPS
+#   define GR_FREEZE_STEPS 5
+#endif // GR_FREEZE_STEPS
+
+// Components of up to this many verticies use all pairs in `GR_RM_SGD`,
+// larger ones the sparse approximation with `GR_SGD_PIVOTS` pivots
+#ifndef GR_SGD_EXACT_LIMIT
+#   define GR_SGD_EXACT_LIMIT 1024
+#endif // GR_SGD_EXACT_LIMIT
+#ifndef GR_SGD_PIVOTS
+#   define GR_SGD_PIVOTS 64
+#endif // GR_SGD_PIVOTS
+
+// Capacity of the neighbor list of every vertex with `verlet_cutoff`, the
+// closest ones are kept
+#ifndef GR_VERLET_NEIGHBORS
+#   define GR_VERLET_NEIGHBORS 32
+#endif // GR_VERLET_NEIGHBORS
+
+// Defining `GR_TILING` for the implementation calculates the exact repulsion
+// of blocks too large for the L1 cache in cache sized tiles. Eades and
+// Fruchterman-Reingold then push each tile of verticies from the positions
+// at the start of the tile instead of the moved ones, which changes the
+// layout. It is off until it measurably pays off, compare both with
+// `./nob bench`.
+
+// Number of steps after which `GR_ORDER_HILBERT` sorts the verticies again
+#ifndef GR_REORDER_STEPS
+#   define GR_REORDER_STEPS 25
+#endif // GR_REORDER_STEPS
+
+// Vertex index stored in graphs and render states. Defining `GR_INDEX32`
+// (for the implementation and every user alike) halves the memory of the
+// adjacency lists, neighbor lists and stress terms, but limits graphs to
+// `UINT32_MAX` verticies. The API still takes `size_t`.
+#ifdef GR_INDEX32
+typedef uint32_t gr_Index;
+#   define GR_INDEX_MAX UINT32_MAX
+#else
+typedef size_t gr_Index;
+#   define GR_INDEX_MAX SIZE_MAX
+#endif // GR_INDEX32
+
 typedef struct {
     float x;
     float y;
@@ -58,14 +168,59 @@ typedef struct {
 #define gr_vec2zero()   gr_vec2(0, 0)
 #define gr_vec2one()    gr_vec2(1, 1)
 
+// Bitmaps with one bit per vertex, stored in 64 bit words
+#define gr_bitmap_words(n)          (((n) + 63) / 64)
+#define gr_bitmap_get(bits, i)      (((bits)[(i) / 64] >> ((i) % 64)) & 1)
+#define gr_bitmap_set(bits, i)      ((bits)[(i) / 64] |= (uint64_t)1 << ((i) % 64))
+#define gr_bitmap_clear(bits, i)    ((bits)[(i) / 64] &= ~((uint64_t)1 << ((i) % 64)))
+
 #define gr_randf(min, max)\
     ((min) + (float)rand() / (float)(RAND_MAX) * ((max) - (min)))
 #define gr_lerpf(v, min1, max1, min2, max2)\
     (min2 + ((v - min1) / (max1 - min1)) * (max2 - min2))
 
+// Allocation hooks, every function gets `user` passed as first argument.
+// All heap memory of graphs and render contexts goes through these.
+typedef struct {
+    void *(*malloc_fn)(void *user, size_t size);
+    void *(*calloc_fn)(void *user, size_t count, size_t size);
+    void (*free_fn)(void *user, void *ptr);
+    void *user;
+} gr_Allocator;
+
+// Allocator using `malloc`, `calloc` and `free` of the C standard library
+gr_Allocator gr_allocator_default(void);
+
+// Bump allocator for scratch memory of a single render step. It is reset at
+// the end of every step and consolidated into one block large enough for the
+// whole step, so after the first step no more heap allocations are necessary.
+typedef struct {
+    struct gr_ArenaBlock *blocks;
+} gr_Arena;
+
+// Ideal length of the edge from `start` to `end` relative to the other edges
+typedef struct {
+    gr_Index start;
+    gr_Index end;
+    float length;
+} gr_EdgeLength;
+
 typedef struct {
     size_t n_verticies;
     bool **edges;
+    // Number of `true` entries in `edges`
+    size_t n_edges;
+    // Lengths of the edges which were given one other than 1, at most one
+    // entry per direction of an edge. All other edges have length 1.
+    gr_EdgeLength *lengths;
+    size_t n_lengths;
+    size_t lengths_capacity;
+    // Incremented whenever a length changes
+    size_t lengths_version;
+    // Union-find forest over the verticies, updated while adding edges. Roots
+    // identify the (weakly) connected components.
+    gr_Index *component_parent;
+    gr_Allocator allocator;
 } gr_Graph;
 
 // Only used in the API for adding edges.
@@ -81,10 +236,14 @@ typedef struct {
 enum gr_RenderMethodKind {
     GR_RM_Eades,
     GR_RM_Fruchterman_and_Reingold,
+    GR_RM_SGD,
+    GR_RM_ForceAtlas2,
 };
 
 #define GR_RM_SPRING_1 GR_RM_Eades
 #define GR_RM_SPRING_2 GR_RM_Fruchterman_and_Reingold
+#define GR_RM_STRESS GR_RM_SGD
+#define GR_RM_FORCE_ATLAS GR_RM_ForceAtlas2
 
 #define GR_DEFAULT_GRAV_CEN gr_vec2zero()
 
@@ -123,26 +282,278 @@ struct gr_RenderMethodFruchtgold {
     gr_Vec2 grav_cen;
 };
 
+#define GR_DEFAULT_SGD_LENGTH       1
+#define GR_DEFAULT_SGD_EPSILON      0.1f
+#define GR_DEFAULT_SGD_ITERATIONS   15
+#define GR_DEFAULT_SGD_PIVOTS       0
+
+// Stress layout by stochastic gradient descent (Zheng, Pawar and Goodman).
+// Every step moves the verticies of all pairs, in random order, towards their
+// distance in the graph. The step size is annealed from `1 / w_min` down to
+// `epsilon / w_max` within `iterations` steps and stays there afterwards.
+struct gr_RenderMethodSGD {
+    const enum gr_RenderMethodKind kind;
+    // Distance of verticies connected by an edge
+    float length;
+    float epsilon;
+    size_t iterations;
+    // Number of pivots of the sparse approximation, which only keeps the
+    // distances along edges and to the pivots. `0` uses all pairs up to
+    // `GR_SGD_EXACT_LIMIT` verticies per component and `GR_SGD_PIVOTS` pivots
+    // for larger ones.
+    size_t pivots;
+    // Center of gravity, only used to place components
+    gr_Vec2 grav_cen;
+};
+
+#define GR_DEFAULT_FORCEATLAS2_SCALING      2
+#define GR_DEFAULT_FORCEATLAS2_GRAVITY      1
+#define GR_DEFAULT_FORCEATLAS2_TOLERANCE    1
+
+// ForceAtlas2 (Jacomy, Venturini, Heymann and Bastian). Verticies repel each
+// other proportional to their degrees, so hubs push their surroundings away,
+// and every vertex moves with its own speed depending on how much it swings.
+struct gr_RenderMethodForceAtlas2 {
+    const enum gr_RenderMethodKind kind;
+    // Strength of the repulsion, the layout gets larger with it
+    float scaling;
+    float gravity;
+    // Gravity growing with the distance to the center instead of a constant
+    // pull, keeps everything compact
+    bool strong_gravity;
+    // Logarithmic attraction, which makes clusters much tighter
+    bool lin_log;
+    // Divide the attraction of a vertex by its degree, hubs end up at the
+    // border of their clusters and authorities in the middle
+    bool dissuade_hubs;
+    // How much swinging is accepted to speed up, lower is more precise
+    float tolerance;
+    // Center of gravity
+    gr_Vec2 grav_cen;
+};
+
 typedef union {
     enum gr_RenderMethodKind kind;
     struct gr_RenderMethodEades eades;
     struct gr_RenderMethodFruchtgold fruchtgold;
+    struct gr_RenderMethodSGD sgd;
+    struct gr_RenderMethodForceAtlas2 force_atlas;
 } gr_RenderMethod;
 
+// Phases of `gr_render_step` which are measured by the perf counters
+enum gr_PerfPhase {
+    // The whole step
+    GR_PERF_STEP,
+    // Force calculation and integration of the render method
+    GR_PERF_FORCES,
+    // Placing the verticies which were removed from the layout
+    GR_PERF_EXPAND,
+    // Packing of the connected components and writing back the positions
+    GR_PERF_PACK,
+    GR_PERF_PHASE_COUNT,
+};
+
+enum gr_PerfCounter {
+    GR_PERF_CYCLES,
+    GR_PERF_INSTRUCTIONS,
+    GR_PERF_CACHE_MISSES,
+    GR_PERF_BRANCH_MISSES,
+    GR_PERF_COUNTER_COUNT,
+};
+
+// Optional hardware performance counters (Linux `perf_event_open`) sampled
+// around the phases of every `gr_render_step`, read together as one group.
+// Only the thread calling `gr_render_step` is measured, so the values per pair
+// interaction are only meaningful with `n_threads == 1`.
+// If the kernel does not permit perf events (or on other platforms) the
+// counters are reported as unavailable and the stepping is not affected.
+typedef struct {
+    // `-1` for every counter that could not be opened
+    int fds[GR_PERF_COUNTER_COUNT];
+    // `errno` of the first failed `perf_event_open`, `0` if all were opened
+    int error;
+    uint64_t steps;
+    // Most threads any of the measured steps ran on
+    size_t max_threads;
+    uint64_t values[GR_PERF_PHASE_COUNT][GR_PERF_COUNTER_COUNT];
+    // Number of evaluated vertex pair interactions
+    uint64_t pairs[GR_PERF_PHASE_COUNT];
+    // Counter readings at the start of the currently running phases
+    uint64_t begin[GR_PERF_PHASE_COUNT][GR_PERF_COUNTER_COUNT];
+} gr_Perf;
+
+// How `gr_render_ctx_create_ex` initializes the positions. `false` and `true`
+// can still be passed for `GR_INIT_NONE` and `GR_INIT_RANDOM`.
+enum gr_InitPositions {
+    // Not even allocated, you have to set `vertex_pos` yourself
+    GR_INIT_NONE,
+    // Uniformly distributed in `[0, 1]` using `rand`
+    GR_INIT_RANDOM,
+    // Layout of `gr_render_ctx_spectral`
+    GR_INIT_SPECTRAL,
+};
+
+// Component type of a `gr_Binding`
+enum gr_BindType {
+    GR_BIND_FLOAT,
+    GR_BIND_DOUBLE,
+};
+
+// Positions inside a buffer of the caller, for example the position members
+// of an array of vertex structs: the x coordinate of vertex `i` is at
+// `base + i * stride` bytes, directly followed by its y coordinate.
+typedef struct {
+    void *base;
+    size_t stride;
+    enum gr_BindType type;
+} gr_Binding;
+
+#define gr_binding(base_, stride_, type_) \
+    ((gr_Binding) { .base = (base_), .stride = (stride_), .type = (type_) })
+
+// Internal order of the laid out verticies, see `gr_RenderContext.vertex_order`
+enum gr_VertexOrder {
+    // Order of the graph (within every component)
+    GR_ORDER_NONE,
+    // Reverse Cuthill-McKee: neighbors get close numbers, computed once
+    GR_ORDER_RCM,
+    // Along a Hilbert curve over the current positions: verticies close to
+    // each other get close numbers, recomputed every `GR_REORDER_STEPS` steps
+    GR_ORDER_HILBERT,
+};
+
 typedef struct {
     const gr_Graph *graph;
     gr_RenderMethod method;
-    // Just stored weather `initialize = true` was passed to `gr_render_ctx_create_ex`.
+    // Just stored weather the positions were allocated by `gr_render_ctx_create_ex`.
     // Only used in `gr_render_ctx_destroy`
     bool positions_initialized;
 
     gr_Vec2 *vertex_pos;
+    // Buffer of the caller every step writes the positions to as well, in
+    // the same pass that moves them out of the internal layout. Not used if
+    // `output.base` is `NULL` (the default).
+    gr_Binding output;
     size_t cur_iteration;
+    // Bounding box of `vertex_pos`, kept up to date by the functions of the
+    // context as a by-product of moving the verticies. Call
+    // `gr_render_ctx_update_bbox` after changing `vertex_pos` yourself.
+    gr_Vec2 bbox_min;
+    gr_Vec2 bbox_max;
+
+    // Set to sample hardware performance counters, `NULL` by default
+    gr_Perf *perf;
+
+    // Lay out every connected component on its own and pack the components
+    // into a compact rectangle afterwards. Components are distributed over
+    // the threads.
+    bool split_components;
+    // Recursively strip all verticies of degree one (trees hanging off the
+    // 2-core) before laying out and reinsert them around their anchors after
+    // every step
+    bool prune_leaves;
+    // Contract maximal paths of degree two verticies into single edges whose
+    // ideal length is scaled by the length of the path. The inner verticies
+    // are placed along the contracted edge after every step.
+    bool compress_chains;
+    // Lay out only one representative of every class of verticies with the
+    // same neighbors, weighted by the size of the class. The others are
+    // fanned out around it after every step.
+    bool collapse_twins;
+    // Verticies which moved less than this fraction of the ideal edge length
+    // for `GR_FREEZE_STEPS` steps are frozen: their forces are not calculated
+    // anymore, but they still act on the others. A neighbor moving more than
+    // a few times as far wakes them up again. `0` disables freezing, which
+    // `GR_RM_SGD` ignores.
+    float freeze_threshold;
+    // Bitmap of verticies which are never moved (see `gr_bitmap_words`),
+    // `NULL` if all verticies are movable. Their forces are not calculated at
+    // all, the others are still laid out around them. Pinned verticies are
+    // never removed by `prune_leaves`, `compress_chains` or `collapse_twins`.
+    // The bitmap can be changed between steps, pointing to another one starts
+    // over.
+    const uint64_t *pinned;
+    // Number of random verticies every vertex is repelled by in a step instead
+    // of all others, scaled up to stand for all of them. Attraction then only
+    // follows the edges. `0` calculates the exact repulsion, `GR_RM_SGD`
+    // ignores it.
+    size_t repulsion_samples;
+    // Only verticies closer than this multiple of the ideal edge length repel
+    // each other. They are remembered in neighbor lists, which are rebuilt
+    // once a vertex moved far enough to possibly have new neighbors. Takes
+    // precedence over `repulsion_samples`, `0` disables it.
+    float verlet_cutoff;
+    // Approximates square roots, logarithms and divisions in the loops over
+    // pairs and edges, so the compiler can vectorize them. Single forces are
+    // off by less than 0.6% (ForceAtlas2 repulsion 0.001%), which does not
+    // make the layouts worse.
+    bool fast_math;
+    // Renumbers the verticies internally, so the passes over edges and
+    // nearby verticies touch memory close together. `vertex_pos`, `pinned`
+    // and everything else still use the ids of the graph.
+    enum gr_VertexOrder vertex_order;
+    // Number of threads used by `gr_render_step`, `1` runs everything on the
+    // calling thread
+    size_t n_threads;
+
+    gr_Allocator allocator;
+    // Scratch memory of the current step
+    gr_Arena scratch;
+    // Number of allocations done through `allocator`. Stays constant for
+    // every `gr_render_step` after the first one (checked by an assertion).
+    // Changing the graph or the options of the context starts over.
+    size_t heap_allocs;
+
+    // Internal data derived from the graph and the options, created by the
+    // first step.
+    struct gr_RenderState *state;
 } gr_RenderContext;
 
-// Returns only false if the internal structures could not be allocated
+// Most verticies of a `gr_SmallContext`
+#define GR_SMALL_MAX 64
+
+// Graph and layout of up to `GR_SMALL_MAX` verticies in one struct without
+// any heap memory: the edges of every vertex are a bitmask and the positions
+// are stored inline. Supports the spring methods (`GR_RM_Eades` and
+// `GR_RM_Fruchterman_and_Reingold`) with edges of length 1 and none of the
+// options of `gr_RenderContext`.
+typedef struct {
+    gr_RenderMethod method;
+    size_t n_verticies;
+    // Bit `u` of `edges[v]` is set if there is an edge from `v` to `u`
+    uint64_t edges[GR_SMALL_MAX];
+    gr_Vec2 vertex_pos[GR_SMALL_MAX];
+    size_t cur_iteration;
+    // Bounding box of `vertex_pos`, like in `gr_RenderContext`
+    gr_Vec2 bbox_min;
+    gr_Vec2 bbox_max;
+    // See `gr_RenderContext.fast_math`
+    bool fast_math;
+} gr_SmallContext;
+
+// Positions of a completed step, published by a layout thread
+typedef struct {
+    const gr_Vec2 *vertex_pos;
+    size_t n_verticies;
+    size_t iteration;
+    gr_Vec2 bbox_min;
+    gr_Vec2 bbox_max;
+} gr_Snapshot;
+
+// Steps a render context on a thread of its own, see `gr_async_start_ex`
+typedef struct gr_AsyncLayout gr_AsyncLayout;
+
+// Returns only false if the internal structures could not be allocated or
+// `n_verticies` does not fit into `gr_Index`.
+// If `allocator` is `NULL` the default allocator is used.
+bool gr_graph_init_ex(gr_Graph *graph, const size_t n_verticies,
+                      const gr_Allocator *allocator);
 bool gr_graph_init(gr_Graph *graph, const size_t n_verticies);
 void gr_graph_destroy(gr_Graph *graph);
+// `length` is the ideal length of the edge relative to the others and
+// replaces the one it had. `0` keeps the length of an existing edge (`1` for
+// new ones), `1` resets it to the default.
+bool gr_graph_add_edge_ex(gr_Graph *graph, const gr_Edge edge, const float length);
 bool gr_graph_add_edge(gr_Graph *graph, const gr_Edge edge);
 // Returns: `0` on success (already existing edges are ignored and won't lead to failure)
 // and `n` when the n-th edge could not be added, following edges are also not added yet.
@@ -153,24 +564,112 @@ size_t gr_graph_add_edges(gr_Graph *graph, const size_t n_edges, const gr_Edge *
 gr_RenderMethod gr_method_create(const enum gr_RenderMethodKind kind);
 #define gr_method_default() (gr_method_create(GR_DEFAULT_METHOD))
 
-// If `init_positions` is `false` you have to initialize it yourself, it won't even
-// be allocated. Otherwise `rand` is used to randomly initialize the position vectors.
+// `init_positions` is one of `gr_InitPositions`, with `GR_INIT_NONE` (`false`)
+// you have to initialize `vertex_pos` yourself, it won't even be allocated.
+// All memory of the context is allocated through `allocator`, if it is `NULL`
+// the allocator of the graph is used.
+gr_RenderContext gr_render_ctx_create_alloc(const gr_Graph *graph,
+                                            const gr_RenderMethod method,
+                                            const int init_positions,
+                                            const gr_Allocator *allocator);
 gr_RenderContext gr_render_ctx_create_ex(const gr_Graph *graph,
                                          const gr_RenderMethod method,
-                                         const bool init_positions);
+                                         const int init_positions);
 #define gr_render_ctx_create(graph) \
     (gr_render_ctx_create_ex((graph), gr_method_default(), true))
 void gr_render_ctx_destroy(gr_RenderContext *ctx);
+// Spectral layout (Hall): places the verticies at the eigenvectors of the two
+// smallest non-trivial eigenvalues of the graph Laplacian, found with the
+// Lanczos method. Much cheaper than stepping, use it as the final layout of
+// huge graphs or as a starting point for the render method. Edge lengths are
+// honored as inverse weights, components are centered on top of each other.
+void gr_render_ctx_spectral(gr_RenderContext *ctx);
+// Recomputes `bbox_min` and `bbox_max` from `vertex_pos`
+void gr_render_ctx_update_bbox(gr_RenderContext *ctx);
 // Lerps all positions into the rectangle described by `mins` and `maxs`
 void gr_render_ctx_normalize_ex(gr_RenderContext *ctx, const gr_Vec2 mins,
                                 const gr_Vec2 maxs);
 #define gr_render_ctx_normalize(ctx) \
     (gr_render_ctx_normalize_ex((ctx), gr_vec2(0.05, 0.05), gr_vec2(0.95, 0.95)))
+// Like `gr_render_ctx_normalize_ex` but writes the positions to `out` (one per
+// vertex) and leaves `vertex_pos` untouched, so stepping can go on from there.
+// `out` can directly be a render buffer of the caller.
+void gr_render_ctx_normalize_into_ex(const gr_RenderContext *ctx, const gr_Vec2 mins,
+                                     const gr_Vec2 maxs, gr_Vec2 *out);
+#define gr_render_ctx_normalize_into(ctx, out) \
+    (gr_render_ctx_normalize_into_ex((ctx), gr_vec2(0.05, 0.05), \
+                                     gr_vec2(0.95, 0.95), (out)))
+// Like `gr_render_ctx_normalize_into_ex` but writes into a strided buffer,
+// for example straight into the vertex structs of a renderer
+void gr_render_ctx_normalize_bound_ex(const gr_RenderContext *ctx, const gr_Vec2 mins,
+                                      const gr_Vec2 maxs, const gr_Binding out);
+#define gr_render_ctx_normalize_bound(ctx, out) \
+    (gr_render_ctx_normalize_bound_ex((ctx), gr_vec2(0.05, 0.05), \
+                                      gr_vec2(0.95, 0.95), (out)))
 void gr_render_step(gr_RenderContext *ctx);
 void gr_render_step_for(gr_RenderContext *ctx, const size_t iterations);
 void gr_render_step_until(gr_RenderContext *ctx, const size_t target_iterations);
 #define gr_render_run(ctx) gr_render_step_until((ctx), GR_DEFAULT_ITERATIONS)
 
+// With `init_positions` the positions are uniformly distributed in `[0, 1]`
+// using `rand`, otherwise they are all zero.
+gr_SmallContext gr_small_ctx_create_ex(const size_t n_verticies,
+                                       const gr_RenderMethod method,
+                                       const bool init_positions);
+#define gr_small_ctx_create(n_verticies) \
+    (gr_small_ctx_create_ex((n_verticies), gr_method_default(), true))
+// Returns `false` if one of the verticies does not exist
+bool gr_small_add_edge(gr_SmallContext *ctx, const gr_Edge edge);
+void gr_small_normalize_into_ex(const gr_SmallContext *ctx, const gr_Vec2 mins,
+                                const gr_Vec2 maxs, gr_Vec2 *out);
+#define gr_small_normalize_into(ctx, out) \
+    (gr_small_normalize_into_ex((ctx), gr_vec2(0.05, 0.05), \
+                                gr_vec2(0.95, 0.95), (out)))
+void gr_small_step(gr_SmallContext *ctx);
+void gr_small_step_for(gr_SmallContext *ctx, const size_t iterations);
+void gr_small_step_until(gr_SmallContext *ctx, const size_t target_iterations);
+#define gr_small_run(ctx) gr_small_step_until((ctx), GR_DEFAULT_ITERATIONS)
+
+// Steps `ctx` on a thread of its own until it reaches `target_iterations`,
+// at most once every `interval` seconds (`0` as fast as possible), optionally
+// starting `paused`. `ctx` (its `output` is used for the snapshots) must not
+// be touched until `gr_async_destroy`, reading its graph is fine. Returns
+// `NULL` if the thread could not be started. With `GR_NO_THREADS` the steps
+// are done by `gr_async_acquire` instead.
+gr_AsyncLayout *gr_async_start_ex(gr_RenderContext *ctx, const size_t target_iterations,
+                                  const double interval, const bool paused);
+#define gr_async_start(ctx) \
+    (gr_async_start_ex((ctx), GR_DEFAULT_ITERATIONS, 0, false))
+// Latest published step, never waits for the layout thread. The snapshot
+// stays valid until the next call.
+const gr_Snapshot *gr_async_acquire(gr_AsyncLayout *async);
+void gr_async_pause(gr_AsyncLayout *async);
+void gr_async_resume(gr_AsyncLayout *async);
+// Lets a paused layout do one more step
+void gr_async_step(gr_AsyncLayout *async);
+// Stops after the current step, the layout cannot be resumed afterwards
+void gr_async_cancel(gr_AsyncLayout *async);
+// `true` once the target iteration is reached or the layout was cancelled
+bool gr_async_done(gr_AsyncLayout *async);
+// Resumes the layout and waits until it reached its target (cancel it first
+// to stop after the current step), then hands the context back
+void gr_async_destroy(gr_AsyncLayout *async);
+void gr_snapshot_normalize_bound_ex(const gr_Snapshot *snapshot, const gr_Vec2 mins,
+                                    const gr_Vec2 maxs, const gr_Binding out);
+#define gr_snapshot_normalize_bound(snapshot, out) \
+    (gr_snapshot_normalize_bound_ex((snapshot), gr_vec2(0.05, 0.05), \
+                                    gr_vec2(0.95, 0.95), (out)))
+
+// Returns `true` if at least one counter could be opened. Even on `false` the
+// perf struct can be attached to a render context and reported.
+bool gr_perf_init(gr_Perf *perf);
+void gr_perf_destroy(gr_Perf *perf);
+// Clears all accumulated values, the counters stay open
+void gr_perf_reset(gr_Perf *perf);
+// Prints cycles, instructions, IPC and misses per pair interaction of every
+// phase. The misses per pair are left out if steps ran on several threads.
+void gr_perf_report(const gr_Perf *perf, FILE *stream);
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
@@ -4,6 +4,7 @@
 
 #define BUILD_DIR "build"
 #define GRAY_C_O (BUILD_DIR "/gray.c.o")
+#define GRAY_NO_THREADS_C_O (BUILD_DIR "/gray-no-threads.c.o")
 #define TO_LOWER(str)\
     for (char *_str_ = (str); *_str_; _str_ += 1) { *_str_ = tolower(*_str_); }
 
@@ -20,6 +21,8 @@ enum SubCommand {
     SharedLib,
     StaticLib,
     Examples,
+    Tests,
+    Bench,
     All,
 };
 
@@ -29,6 +32,8 @@ static const char *subcmd_strs[All + 1] = {
     [SharedLib] = "sharedlib",
     [StaticLib] = "staticlib",
     [Examples] = "examples",
+    [Tests] = "tests",
+    [Bench] = "bench",
     [All] = "all",
 };
 
@@ -38,6 +43,8 @@ static const char *subcmd_desc[All + 1] = {
     [SharedLib] = "Compile to a shared library",
     [StaticLib] = "Compile to a static library",
     [Examples] = "Compile all examples",
+    [Tests] = "Compile and run all tests",
+    [Bench] = "Compile and run the benchmarks (optimized)",
     [All] = "Create single header file, build shared and static library and compile examples",
 };
 
@@ -45,6 +52,8 @@ bool require_build_dir()
 {
     if (!nob_mkdir_if_not_exists(BUILD_DIR))              { return false; }
     if (!nob_mkdir_if_not_exists(BUILD_DIR "/examples" )) { return false; }
+    if (!nob_mkdir_if_not_exists(BUILD_DIR "/tests" ))    { return false; }
+    if (!nob_mkdir_if_not_exists(BUILD_DIR "/bench" ))    { return false; }
     return true;
 }
 
@@ -57,26 +66,44 @@ bool create_single_header(Nob_Cmd *cmd)
     Nob_String_Builder reader = { 0 };
     Nob_String_Builder sb = { 0 };
 
-    if (!nob_read_entire_file("gray.h", &reader)) {
+    if (!nob_read_entire_file("gray.c", &reader)) {
         result = false;
         goto cleanup;
     }
-    nob_sb_append_buf(&sb, reader.items, reader.count);
-    reader.count = 0;
+    // everything in gray.c before `#include "gray.h"` has to come before the
+    // system headers included by gray.h as well
+    Nob_String_View impl = nob_sv_from_parts(reader.items, reader.count);
+    Nob_String_View prelude = nob_sv_chop_by_delim(&impl, '\n');
+    while (!nob_sv_eq(prelude, nob_sv_from_cstr("#include \"gray.h\""))) {
+        if (impl.count == 0) {
+            nob_log(NOB_ERROR, "gray.c does not include gray.h");
+            result = false;
+            goto cleanup;
+        }
+        prelude = nob_sv_chop_by_delim(&impl, '\n');
+    }
+    prelude.count = prelude.data - reader.items;
+    prelude.data = reader.items;
+
+    nob_sb_append_cstr(&sb, "#ifdef GRAY_IMPLEMENTATION\n");
+    nob_sb_append_buf(&sb, prelude.data, prelude.count);
+    nob_sb_append_cstr(&sb, "#endif // GRAY_IMPLEMENTATION\n\n");
+
+    Nob_String_Builder header = { 0 };
+    if (!nob_read_entire_file("gray.h", &header)) {
+        nob_sb_free(header);
+        result = false;
+        goto cleanup;
+    }
+    nob_sb_append_buf(&sb, header.items, header.count);
+    nob_sb_free(header);
 
     nob_sb_append_cstr(&sb, "\n"
                        "#ifndef _GRAY_ALREADY_IMPLEMENTED_\n"
                        "#    ifdef GRAY_IMPLEMENTATION\n"
                        "#        define _GRAY_ALREADY_IMPLEMENTED_\n\n");
 
-    // comments out the `#include "gray.h"` in gray.c
-    nob_sb_append_cstr(&sb, "// ");
-
-    if (!nob_read_entire_file("gray.c", &reader)) {
-        result = false;
-        goto cleanup;
-    }
-    nob_sb_append_buf(&sb, reader.items, reader.count);
+    nob_sb_append_buf(&sb, impl.data, impl.count);
 
     nob_sb_append_cstr(&sb, "\n"
                        "#    endif // GRAY_IMPLEMENTATION\n"
@@ -133,7 +160,8 @@ bool build_examples(Nob_Cmd *cmd)
                        BUILD_DIR "/examples/" name ".c.o");                    \
         if (!nob_cmd_run_sync_and_reset(cmd)) { return false; }                \
         nob_cmd_append(cmd, CC, GRAY_C_O, BUILD_DIR "/examples/" name ".c.o",  \
-                       "-lm", "-lraylib", "-o", BUILD_DIR "/examples/" name);  \
+                       "-lm", "-lpthread", "-lraylib", "-o",                   \
+                       BUILD_DIR "/examples/" name);                           \
         if (!nob_cmd_run_sync_and_reset(cmd)) { return false; }                \
     } while (0);
 
@@ -144,6 +172,64 @@ bool build_examples(Nob_Cmd *cmd)
     return true;
 }
 
+bool run_tests(Nob_Cmd *cmd)
+{
+    nob_log(NOB_INFO, "Running tests");
+
+    nob_cmd_append(cmd, CC, CF, "-c", "gray.c", "-o", GRAY_C_O);
+    if (!nob_cmd_run_sync_and_reset(cmd)) { return false; }
+    // the build without threads, which is also the one on Windows
+    nob_cmd_append(cmd, CC, CF, "-Werror=incompatible-pointer-types", "-DGR_NO_THREADS",
+                   "-c", "gray.c", "-o", GRAY_NO_THREADS_C_O);
+    if (!nob_cmd_run_sync_and_reset(cmd)) { return false; }
+
+    // every test runs against both builds
+    #define test(name) do {\
+        nob_cmd_append(cmd, CC, CF, "tests/" name ".c", GRAY_C_O, "-lm",       \
+                       "-lpthread", "-o", BUILD_DIR "/tests/" name);           \
+        if (!nob_cmd_run_sync_and_reset(cmd)) { return false; }                \
+        nob_cmd_append(cmd, BUILD_DIR "/tests/" name);                         \
+        if (!nob_cmd_run_sync_and_reset(cmd)) { return false; }                \
+        nob_cmd_append(cmd, CC, CF, "tests/" name ".c", GRAY_NO_THREADS_C_O,   \
+                       "-lm", "-o", BUILD_DIR "/tests/" name "-no-threads");   \
+        if (!nob_cmd_run_sync_and_reset(cmd)) { return false; }                \
+        nob_cmd_append(cmd, BUILD_DIR "/tests/" name "-no-threads");           \
+        if (!nob_cmd_run_sync_and_reset(cmd)) { return false; }                \
+    } while (0);
+
+    test("heap_allocs");
+    test("fast_math");
+
+    #undef test
+    return true;
+}
+
+bool run_benchmarks(Nob_Cmd *cmd)
+{
+    nob_log(NOB_INFO, "Running benchmarks");
+
+    // every benchmark is compiled once as is and once with `flag`, which
+    // switches on what it measures
+    #define bench(name, flag) do {\
+        nob_cmd_append(cmd, CC, CF, "-O2", "bench/" name ".c", "gray.c", "-lm", \
+                       "-lpthread", "-o", BUILD_DIR "/bench/" name);           \
+        if (!nob_cmd_run_sync_and_reset(cmd)) { return false; }                \
+        nob_cmd_append(cmd, CC, CF, "-O2", "-D" flag, "bench/" name ".c",      \
+                       "gray.c", "-lm", "-lpthread", "-o",                     \
+                       BUILD_DIR "/bench/" name "-" flag);                     \
+        if (!nob_cmd_run_sync_and_reset(cmd)) { return false; }                \
+        nob_cmd_append(cmd, BUILD_DIR "/bench/" name);                         \
+        if (!nob_cmd_run_sync_and_reset(cmd)) { return false; }                \
+        nob_cmd_append(cmd, BUILD_DIR "/bench/" name "-" flag);                \
+        if (!nob_cmd_run_sync_and_reset(cmd)) { return false; }                \
+    } while (0);
+
+    bench("tiling", "GR_TILING");
+
+    #undef bench
+    return true;
+}
+
 int main(int argc, char **argv)
 {
     NOB_GO_REBUILD_URSELF(argc, argv);
@@ -183,6 +269,12 @@ int main(int argc, char **argv)
     } else if (strcmp(subcommand, subcmd_strs[Examples]) == 0) {
         if (!require_build_dir())    { return EXIT_FAILURE; }
         if (!build_examples(&cmd))       { return EXIT_FAILURE; }
+    } else if (strcmp(subcommand, subcmd_strs[Tests]) == 0) {
+        if (!require_build_dir())    { return EXIT_FAILURE; }
+        if (!run_tests(&cmd))            { return EXIT_FAILURE; }
+    } else if (strcmp(subcommand, subcmd_strs[Bench]) == 0) {
+        if (!require_build_dir())    { return EXIT_FAILURE; }
+        if (!run_benchmarks(&cmd))       { return EXIT_FAILURE; }
     } else if (strcmp(subcommand, subcmd_strs[All]) == 0) {
         if (!require_build_dir())    { return EXIT_FAILURE; }
 
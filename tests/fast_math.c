@@ -0,0 +1,213 @@
+// `fast_math` may move every vertex a little differently, but the layouts it
+// settles in must be as good as the precise ones. Runs the methods from the
+// same seeds both ways and compares the medians over the seeds of the spread
+// of the edge lengths and of the stress.
+//
+// Fruchterman-Reingold is left out: it moves every vertex by its force times
+// the temperature without limiting the displacement, and with the default
+// temperature it diverges to NaN on this graph within the first step, with
+// and without `fast_math`.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../gray.h"
+
+#define SEEDS 5
+#define STEPS 150
+// Largest allowed relative difference of the statistics
+#define TOLERANCE 0.15
+
+typedef struct {
+    double edge_spread;
+    double stress;
+} Stats;
+
+static const char *method_names[] = {
+    [GR_RM_Eades] = "Eades",
+    [GR_RM_SGD] = "SGD",
+    [GR_RM_ForceAtlas2] = "ForceAtlas2",
+};
+
+// A grid, a binary tree hanging off one corner and a cycle through another
+static size_t build_graph(Graph *g)
+{
+    const size_t w = 8;
+    for (size_t y = 0; y < w; y += 1) {
+        for (size_t x = 0; x < w; x += 1) {
+            if (x + 1 < w) { graph_add_edge(g, edge_u(y * w + x, y * w + x + 1)); }
+            if (y + 1 < w) { graph_add_edge(g, edge_u(y * w + x, (y + 1) * w + x)); }
+        }
+    }
+    size_t v = w * w;
+    graph_add_edge(g, edge_u(0, v));
+    for (size_t i = 1; i < 15; i += 1) {
+        graph_add_edge(g, edge_u(v + (i - 1) / 2, v + i));
+    }
+    v += 15;
+    graph_add_edge(g, edge_u(w * w - 1, v));
+    for (size_t i = 0; i < 11; i += 1) {
+        graph_add_edge(g, edge_u(v + i, v + i + 1));
+    }
+    graph_add_edge(g, edge_u(v + 11, w * w - 1));
+    return v + 12;
+}
+
+static double distance(Vec2 a, Vec2 b)
+{
+    return hypot((double)a.x - b.x, (double)a.y - b.y);
+}
+
+// Graph theoretic distances by a breadth first search from every vertex
+static void all_distances(const Graph *g, size_t *dist)
+{
+    const size_t n = g->n_verticies;
+    size_t *queue = malloc(n * sizeof(*queue));
+    for (size_t s = 0; s < n; s += 1) {
+        size_t *d = dist + s * n;
+        for (size_t i = 0; i < n; i += 1) { d[i] = SIZE_MAX; }
+        d[s] = 0;
+        size_t head = 0, tail = 0;
+        queue[tail++] = s;
+        while (head < tail) {
+            const size_t u = queue[head++];
+            for (size_t i = 0; i < n; i += 1) {
+                if (g->edges[u][i] && d[i] == SIZE_MAX) {
+                    d[i] = d[u] + 1;
+                    queue[tail++] = i;
+                }
+            }
+        }
+    }
+    free(queue);
+}
+
+// Coefficient of variation of the edge lengths, and the stress of the layout
+// scaled to fit the graph theoretic distances best, per pair
+static Stats layout_stats(const Graph *g, const size_t *dist, const Vec2 *pos)
+{
+    const size_t n = g->n_verticies;
+    double sum = 0, sum_sq = 0;
+    size_t count = 0;
+    double num = 0, den = 0;
+    for (size_t i = 0; i < n; i += 1) {
+        for (size_t j = i + 1; j < n; j += 1) {
+            const double l = distance(pos[i], pos[j]);
+            if (g->edges[i][j] || g->edges[j][i]) {
+                sum += l;
+                sum_sq += l * l;
+                count += 1;
+            }
+            const double d = (double)dist[i * n + j];
+            num += l / d;
+            den += l * l / (d * d);
+        }
+    }
+    const double scale = den > 0 ? num / den : 0;
+    double stress = 0;
+    for (size_t i = 0; i < n; i += 1) {
+        for (size_t j = i + 1; j < n; j += 1) {
+            const double d = (double)dist[i * n + j];
+            const double e = scale * distance(pos[i], pos[j]) - d;
+            stress += e * e / (d * d);
+        }
+    }
+    const double mean = sum / count;
+    return (Stats) {
+        .edge_spread = sqrt(fmax(sum_sq / count - mean * mean, 0)) / mean,
+        .stress = stress / (n * (n - 1) / 2),
+    };
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    const double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double *values)
+{
+    qsort(values, SEEDS, sizeof(*values), compare_doubles);
+    return values[SEEDS / 2];
+}
+
+static bool run(const Graph *g, const size_t *dist, int method, bool fast_math, Stats *stats)
+{
+    double edge_spread[SEEDS], stress[SEEDS];
+    for (unsigned seed = 1; seed <= SEEDS; seed += 1) {
+        srand(seed);
+        RenderContext ctx = render_ctx_create_ex(g, gr_method_create(method), INIT_RANDOM);
+        // a jittered grid, Eades flings verticies which start almost on top
+        // of each other far away and takes long to pull them back
+        for (size_t i = 0; i < g->n_verticies; i += 1) {
+            ctx.vertex_pos[i] = vec2((float)(i % 10) + 0.5f * rand() / RAND_MAX,
+                                     (float)(i / 10) + 0.5f * rand() / RAND_MAX);
+        }
+        render_ctx_update_bbox(&ctx);
+        ctx.fast_math = fast_math;
+        render_step_for(&ctx, STEPS);
+        for (size_t i = 0; i < g->n_verticies; i += 1) {
+            if (!isfinite(ctx.vertex_pos[i].x) || !isfinite(ctx.vertex_pos[i].y)) {
+                fprintf(stderr, "FAILED: %s %s diverged from seed %u\n", method_names[method],
+                        fast_math ? "with fast_math" : "without fast_math", seed);
+                render_ctx_destroy(&ctx);
+                return false;
+            }
+        }
+        const Stats s = layout_stats(g, dist, ctx.vertex_pos);
+        edge_spread[seed - 1] = s.edge_spread;
+        stress[seed - 1] = s.stress;
+        render_ctx_destroy(&ctx);
+    }
+    *stats = (Stats) { .edge_spread = median(edge_spread), .stress = median(stress) };
+    return true;
+}
+
+static bool within(double precise, double fast)
+{
+    return fabs(fast - precise) <= TOLERANCE * fabs(precise);
+}
+
+int main(void)
+{
+    const size_t n = 8 * 8 + 15 + 12;
+    Graph g = { 0 };
+    if (!graph_init(&g, n)) {
+        fprintf(stderr, "Could not create the graph\n");
+        return EXIT_FAILURE;
+    }
+    if (build_graph(&g) != n) {
+        fprintf(stderr, "The test graph does not have %zu verticies\n", n);
+        return EXIT_FAILURE;
+    }
+    size_t *dist = malloc(n * n * sizeof(*dist));
+    all_distances(&g, dist);
+
+    size_t failed = 0;
+    const int methods[] = {
+        GR_RM_Eades, GR_RM_SGD, GR_RM_ForceAtlas2,
+    };
+    for (size_t m = 0; m < sizeof(methods) / sizeof(methods[0]); m += 1) {
+        Stats precise, fast;
+        if (!run(&g, dist, methods[m], false, &precise) ||
+            !run(&g, dist, methods[m], true, &fast)) {
+            failed += 1;
+            continue;
+        }
+        const bool ok = within(precise.edge_spread, fast.edge_spread) &&
+                        within(precise.stress, fast.stress);
+        fprintf(ok ? stdout : stderr, "%s%-12s edge spread %.4f / %.4f, stress %.4f / %.4f "
+                "(precise / fast)\n", ok ? "" : "FAILED: ", method_names[methods[m]],
+                precise.edge_spread, fast.edge_spread, precise.stress, fast.stress);
+        failed += !ok;
+    }
+    free(dist);
+    graph_destroy(&g);
+
+    if (failed > 0) {
+        fprintf(stderr, "%zu methods lay out differently with fast_math\n", failed);
+        return EXIT_FAILURE;
+    }
+    printf("fast_math: ok\n");
+    return EXIT_SUCCESS;
+}
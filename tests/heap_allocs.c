@@ -0,0 +1,175 @@
+// Every render step after the first one must get along without any heap
+// allocation, for every method and every option which changes the step.
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../gray.h"
+
+#define STEPS 30
+
+typedef struct {
+    size_t allocs;
+} Counter;
+
+static void *counting_malloc(void *user, size_t size)
+{
+    ((Counter *)user)->allocs += 1;
+    return malloc(size);
+}
+
+static void *counting_calloc(void *user, size_t count, size_t size)
+{
+    ((Counter *)user)->allocs += 1;
+    return calloc(count, size);
+}
+
+static void counting_free(void *user, void *ptr)
+{
+    (void)user;
+    free(ptr);
+}
+
+enum Option {
+    OPT_NONE,
+    OPT_SPLIT,
+    OPT_LEAVES,
+    OPT_CHAINS,
+    OPT_TWINS,
+    OPT_FREEZE,
+    OPT_PINNED,
+    OPT_SAMPLES,
+    OPT_VERLET,
+    OPT_FAST_MATH,
+    OPT_ORDER_RCM,
+    OPT_ORDER_HILBERT,
+    OPT_ALL,
+    OPT_COUNT,
+};
+
+static const char *option_names[OPT_COUNT] = {
+    [OPT_NONE] = "none",
+    [OPT_SPLIT] = "split_components",
+    [OPT_LEAVES] = "prune_leaves",
+    [OPT_CHAINS] = "compress_chains",
+    [OPT_TWINS] = "collapse_twins",
+    [OPT_FREEZE] = "freeze_threshold",
+    [OPT_PINNED] = "pinned",
+    [OPT_SAMPLES] = "repulsion_samples",
+    [OPT_VERLET] = "verlet_cutoff",
+    [OPT_FAST_MATH] = "fast_math",
+    [OPT_ORDER_RCM] = "vertex_order rcm",
+    [OPT_ORDER_HILBERT] = "vertex_order hilbert",
+    [OPT_ALL] = "all",
+};
+
+static const char *method_names[] = {
+    [GR_RM_Eades] = "Eades",
+    [GR_RM_Fruchterman_and_Reingold] = "Fruchterman-Reingold",
+    [GR_RM_SGD] = "SGD",
+    [GR_RM_ForceAtlas2] = "ForceAtlas2",
+};
+
+// A grid with trees, a chain and twins hanging off it, and a second component
+static void build_graph(Graph *g)
+{
+    const size_t w = 8;
+    for (size_t y = 0; y < w; y += 1) {
+        for (size_t x = 0; x < w; x += 1) {
+            if (x + 1 < w) { graph_add_edge(g, edge_u(y * w + x, y * w + x + 1)); }
+            if (y + 1 < w) { graph_add_edge(g, edge_u(y * w + x, (y + 1) * w + x)); }
+        }
+    }
+    size_t v = w * w;
+    // leaves and a small tree
+    graph_add_edge(g, edge_u(0, v));
+    graph_add_edge(g, edge_u(v, v + 1));
+    graph_add_edge(g, edge_u(v, v + 2));
+    graph_add_edge(g, edge_u(9, v + 3));
+    v += 4;
+    // chain between two corners of the grid
+    graph_add_edge(g, edge_u(w - 1, v));
+    for (size_t i = 0; i < 5; i += 1) {
+        graph_add_edge(g, edge_u(v + i, v + i + 1));
+    }
+    graph_add_edge(g, edge_u(v + 5, w * w - 1));
+    v += 6;
+    // twins of the verticies 20 and 22
+    for (size_t i = 0; i < 4; i += 1) {
+        graph_add_edge(g, edge_u(20, v + i));
+        graph_add_edge(g, edge_u(22, v + i));
+    }
+    v += 4;
+    // a cycle as its own component
+    for (size_t i = 0; i < 10; i += 1) {
+        graph_add_edge(g, edge_u(v + i, v + (i + 1) % 10));
+    }
+}
+
+int main(void)
+{
+    const size_t n = 8 * 8 + 4 + 6 + 4 + 10;
+    Counter counter = { 0 };
+    const Allocator allocator = {
+        .malloc_fn = counting_malloc,
+        .calloc_fn = counting_calloc,
+        .free_fn = counting_free,
+        .user = &counter,
+    };
+    Graph g = { 0 };
+    if (!graph_init_ex(&g, n, &allocator)) {
+        fprintf(stderr, "Could not create the graph\n");
+        return EXIT_FAILURE;
+    }
+    build_graph(&g);
+    uint64_t pinned[bitmap_words(8 * 8 + 4 + 6 + 4 + 10)] = { 0 };
+    bitmap_set(pinned, 27);
+
+    size_t failed = 0;
+    const int methods[] = {
+        GR_RM_Eades, GR_RM_Fruchterman_and_Reingold, GR_RM_SGD, GR_RM_ForceAtlas2,
+    };
+    for (size_t m = 0; m < sizeof(methods) / sizeof(methods[0]); m += 1) {
+        for (int opt = 0; opt < OPT_COUNT; opt += 1) {
+            for (size_t threads = 1; threads <= 4; threads += 3) {
+                srand(1);
+                RenderContext ctx = render_ctx_create_alloc(&g, gr_method_create(methods[m]),
+                                                            INIT_RANDOM, NULL);
+                ctx.n_threads = threads;
+                const bool all = opt == OPT_ALL;
+                ctx.split_components = all || opt == OPT_SPLIT;
+                ctx.prune_leaves = all || opt == OPT_LEAVES;
+                ctx.compress_chains = all || opt == OPT_CHAINS;
+                ctx.collapse_twins = all || opt == OPT_TWINS;
+                ctx.freeze_threshold = all || opt == OPT_FREEZE ? 0.05f : 0;
+                ctx.pinned = all || opt == OPT_PINNED ? pinned : NULL;
+                ctx.repulsion_samples = all || opt == OPT_SAMPLES ? 8 : 0;
+                ctx.verlet_cutoff = all || opt == OPT_VERLET ? 2 : 0;
+                ctx.fast_math = all || opt == OPT_FAST_MATH;
+                ctx.vertex_order = opt == OPT_ORDER_RCM ? ORDER_RCM :
+                                   all || opt == OPT_ORDER_HILBERT ? ORDER_HILBERT :
+                                   ORDER_NONE;
+
+                render_step(&ctx);
+                const size_t allocs = counter.allocs;
+                const size_t heap_allocs = ctx.heap_allocs;
+                render_step_for(&ctx, STEPS);
+                if (counter.allocs != allocs || ctx.heap_allocs != heap_allocs) {
+                    fprintf(stderr, "FAILED: %s with %s on %zu thread(s): %zu allocations "
+                            "after the first step\n", method_names[methods[m]],
+                            option_names[opt], threads, counter.allocs - allocs);
+                    failed += 1;
+                }
+                render_ctx_destroy(&ctx);
+            }
+        }
+    }
+    graph_destroy(&g);
+
+    if (failed > 0) {
+        fprintf(stderr, "%zu of %d configurations allocated while stepping\n", failed,
+                (int)(sizeof(methods) / sizeof(methods[0])) * OPT_COUNT * 2);
+        return EXIT_FAILURE;
+    }
+    printf("heap_allocs: ok\n");
+    return EXIT_SUCCESS;
+}